@@ -1,13 +1,13 @@
 #include "ark/ark.hpp"
 #include "ark/prelude.hpp"
 #include "ark/storage/bucket_array.hpp"
-#include "ark/third_party/ThreadPool.hpp"
 #include "benchmark.hpp"
 #include "types.hpp"
 
 #include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <span>
 
 #include <chrono>
 using namespace std::chrono;
@@ -69,13 +69,15 @@ struct CreateDestroySystem {
     static void run(FollowedEntities followed, ReadComponent<Position> position,
                     EntityBuilder<GameComponents> builder, EntityDestroyer destroy)
     {
-        followed.for_each([&](const EntityID id) -> void {
-            if (is_offscreen(position[id])) {
-                entities_destroyed++;
-                destroy(id);
-                make_new_entity(builder);
-            }
-        });
+        std::span<const EntityID> offscreen =
+            followed.par_filter([&](const EntityID id) { return is_offscreen(position[id]); });
+
+        destroy.destroy(offscreen);
+        for (size_t i = 0; i < offscreen.size(); i++) {
+            make_new_entity(builder);
+        }
+
+        entities_destroyed += offscreen.size();
     }
 };
 
@@ -88,6 +90,11 @@ int main()
 {
     auto build_world = [](size_t num_entities) -> GameWorld* {
         GameWorld* world = GameWorld::init([](auto&) {});
+        world->reserve(num_entities);
+        world->reserve<Position>(num_entities);
+        world->reserve<Velocity>(num_entities);
+        world->reserve<Angle>(num_entities);
+        world->reserve<RotationalVelocity>(num_entities);
         world->build_entities([&](EntityBuilder<GameComponents> builder) {
             for (size_t i = 0; i < num_entities; i++) {
                 make_new_entity(builder);
@@ -101,11 +108,8 @@ int main()
     };
 
     auto bench2 = [](GameWorld* world) {
-        const auto start = high_resolution_clock::now();
         world->run_systems_sequential<TranslationSystem, RotationSystem>();
         world->run_systems_sequential<CreateDestroySystem>();
-        const auto end = high_resolution_clock::now();
-        const double dur = duration_cast<duration<double>>(end - start).count();
     };
 
     for (size_t num_entities : {1000, 10000, 50000, 100000}) {
@@ -2,7 +2,6 @@
 #include "ark/prelude.hpp"
 // #include "ark/storage/bucket_array.hpp"
 #include "ark/storage/robin_hood.hpp"
-#include "ark/third_party/ThreadPool.hpp"
 #include "benchmark.hpp"
 
 #include <cstdlib>
@@ -56,9 +55,7 @@ int main()
         GameWorld* world = GameWorld::init([](auto&) {});
 
         world->build_entities([&](EntityBuilder<GameComponents> builder) {
-            for (size_t i = 0; i < num_entities; i++) {
-                builder.new_entity().attach<R>().attach<W1>().attach<W2>();
-            }
+            builder.spawn_batch<R, W1, W2>(num_entities);
         });
 
         return world;
@@ -33,11 +33,9 @@ int main()
         GameWorld* world = GameWorld::init([](auto&) {});
 
         world->build_entities([&](Builder builder) {
-            for (size_t i = 0; i < num_entities; i++) {
-                builder.new_entity()
-                    .attach<Position>(Position{0.f, 0.f})
-                    .attach<Velocity>(Velocity{1.f, 1.f});
-            }
+            builder.spawn_batch<Position, Velocity>(
+                num_entities, [](EntityID) { return Position{0.f, 0.f}; },
+                [](EntityID) { return Velocity{1.f, 1.f}; });
         });
 
         return world;
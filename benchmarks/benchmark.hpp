@@ -5,6 +5,10 @@
 #include <iomanip>
 #include <math.h>
 
+#ifdef ARK_TRACK_ALLOCATIONS
+#include "ark/allocation_tracking.hpp"
+#endif
+
 using namespace std::chrono;
 
 template <typename BuildFunc, typename IterFunc>
@@ -63,6 +67,14 @@ void ecs_bench(const char* label,
         }
     }
 
+#ifdef ARK_TRACK_ALLOCATIONS
+    const size_t allocations_before = ark::total_heap_allocations();
+#endif
+
+#ifdef ARK_ENABLE_STATS
+    world->reset_stats();
+#endif
+
     do { // the actual iteration benchmarking
         const auto iter_start_time = high_resolution_clock::now();
         for (size_t ichunk = 0; ichunk < bench_chunk_size; ichunk++) {
@@ -85,6 +97,16 @@ void ecs_bench(const char* label,
         std::cout << '\r' << "iterations completed: " << std::setw(2) << std::setfill('0') << total_iterations << std::flush;
     } while (stddev()/std::abs(mean) > relative_precision);
 
+#ifdef ARK_TRACK_ALLOCATIONS
+    const size_t allocations = ark::total_heap_allocations() - allocations_before;
+    const double iterations_timed = (count - 1.0) * (double) bench_chunk_size;
+#endif
+
+#ifdef ARK_ENABLE_STATS
+    const ark::StatsReport stats = world->stats_report();
+    const ark::ThreadPoolStats thread_pool_stats = world->thread_pool_stats();
+#endif
+
     delete world;
 
     std::cout << std::endl;
@@ -97,6 +119,15 @@ void ecs_bench(const char* label,
               << std::endl << "                           [ " << overhead_60fps << "% of frame @ 60fps]"
               << std::endl;
 
+#ifdef ARK_TRACK_ALLOCATIONS
+    std::cout << "heap allocations per iteration: " << (double) allocations / iterations_timed
+              << std::endl;
+#endif
+
+#ifdef ARK_ENABLE_STATS
+    std::cout << stats << thread_pool_stats;
+#endif
+
     std::cout << "===================================================================" << std::endl;
     std::cout << std::endl;
 }
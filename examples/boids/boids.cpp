@@ -249,7 +249,7 @@ public:
 
     inline real_t population(void) const { return m_population; }
 
-    void get_pseudoboid_neighbors(const Boid& boid, std::vector<PseudoBoid>& results) const
+    void get_pseudoboid_neighbors(const Boid& boid, ArenaVector<PseudoBoid>& results) const
     {
         results.clear();
 
@@ -310,16 +310,16 @@ struct RuleAvgVel {
 struct AvgVelRuleSystem {
     using Subscriptions = TypeList<Boid, RuleAvgVel>;
 
-    using SystemData =
-        std::tuple<ReadComponent<Boid>, WriteComponent<RuleAvgVel>, ReadResource<Grid>>;
+    using SystemData = std::tuple<ReadComponent<Boid>, WriteComponent<RuleAvgVel>,
+                                  ReadResource<Grid>, FrameArena>;
 
     static constexpr real_t STRENGTH = 1.5;
 
     static void run(FollowedEntities followed, SystemData data)
     {
-        auto [boid, avgvel_rule, grid] = data;
+        auto [boid, avgvel_rule, grid, arena] = data;
 
-        static std::vector<PseudoBoid> pseudoboid_buffer;
+        ArenaVector<PseudoBoid> pseudoboid_buffer = arena.vector<PseudoBoid>();
         followed.for_each([&](const EntityID id) -> void {
             const Boid& b = boid[id];
             grid->get_pseudoboid_neighbors(b, pseudoboid_buffer);
@@ -385,16 +385,16 @@ struct RuleDensity {
 struct DensityRuleSystem {
     using Subscriptions = TypeList<Boid, RuleDensity>;
 
-    using SystemData =
-        std::tuple<ReadComponent<Boid>, WriteComponent<RuleDensity>, ReadResource<Grid>>;
+    using SystemData = std::tuple<ReadComponent<Boid>, WriteComponent<RuleDensity>,
+                                  ReadResource<Grid>, FrameArena>;
 
     static constexpr real_t STRENGTH = 100;
 
     static void run(FollowedEntities followed, SystemData data)
     {
-        auto [boid, density_rule, grid] = data;
+        auto [boid, density_rule, grid, arena] = data;
 
-        static std::vector<PseudoBoid> pseudoboid_buffer;
+        ArenaVector<PseudoBoid> pseudoboid_buffer = arena.vector<PseudoBoid>();
         followed.for_each([&](const EntityID id) -> void {
             const Boid& b = boid[id];
             //@OPTIMIZE: do for_each_neighbor to avoid copies?
@@ -429,16 +429,16 @@ struct RuleCOM {
 struct CenterOfMassRuleSystem {
     using Subscriptions = TypeList<Boid, RuleCOM>;
 
-    using SystemData = std::tuple<ReadComponent<Boid>, WriteComponent<RuleCOM>, ReadResource<Grid>>;
+    using SystemData = std::tuple<ReadComponent<Boid>, WriteComponent<RuleCOM>,
+                                  ReadResource<Grid>, FrameArena>;
 
     static constexpr real_t STRENGTH = 18.5;
 
-    static std::vector<PseudoBoid> pseudoboid_buffer;
     static void run(FollowedEntities followed, SystemData data)
     {
-        auto [boid, com_rule, grid] = data;
+        auto [boid, com_rule, grid, arena] = data;
 
-        static std::vector<PseudoBoid> pseudoboid_buffer;
+        ArenaVector<PseudoBoid> pseudoboid_buffer = arena.vector<PseudoBoid>();
         followed.for_each([&](const EntityID id) -> void {
             const Boid& b = boid[id];
             grid->get_pseudoboid_neighbors(b, pseudoboid_buffer);
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <new>
+
+// Allocation tracking mode.
+// When ARK_TRACK_ALLOCATIONS is defined, ark replaces the global operator new/delete with
+// versions that count every heap allocation made by the program. Allocations are attributed
+// to the System being run by the allocating thread (including work done on its behalf on the
+// ThreadPool and the World's post-processing of its structural changes), which ark::World
+// exposes through 'allocations_last_run<S>()' and 'print_allocation_report'.
+//
+// Like the rest of ark, this header defines non-inline functions and must only end up in a
+// single translation unit when tracking is enabled.
+
+namespace ark::detail {
+
+inline std::atomic<size_t> total_allocations{0};
+
+// counter for the System currently being run by this thread, if any
+inline thread_local std::atomic<size_t>* thread_allocation_counter = nullptr;
+
+// Attribute all allocations made by the current thread to 'counter' until the end of scope.
+class AllocationScope {
+#ifdef ARK_TRACK_ALLOCATIONS
+    std::atomic<size_t>* m_previous;
+
+public:
+    AllocationScope(std::atomic<size_t>* counter) : m_previous(thread_allocation_counter)
+    {
+        thread_allocation_counter = counter;
+    }
+
+    ~AllocationScope(void) { thread_allocation_counter = m_previous; }
+#else
+public:
+    AllocationScope(std::atomic<size_t>*) {}
+#endif
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+};
+
+inline void count_allocation(void)
+{
+    total_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (std::atomic<size_t>* counter = thread_allocation_counter) {
+        counter->fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void* tracked_malloc(size_t size)
+{
+    count_allocation();
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (!ptr) std::terminate(); // ark doesn't use exceptions
+    return ptr;
+}
+
+inline void* tracked_aligned_malloc(size_t size, std::align_val_t alignment)
+{
+    count_allocation();
+    const size_t align = static_cast<size_t>(alignment);
+    const size_t rounded = (size + align - 1) / align * align;
+    void* ptr = std::aligned_alloc(align, rounded == 0 ? align : rounded);
+    if (!ptr) std::terminate();
+    return ptr;
+}
+
+} // namespace ark::detail
+
+namespace ark {
+
+// total number of heap allocations made by the program so far (always 0 unless
+// ARK_TRACK_ALLOCATIONS is defined)
+inline size_t total_heap_allocations(void)
+{
+    return detail::total_allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace ark
+
+#ifdef ARK_TRACK_ALLOCATIONS
+
+void* operator new(std::size_t size) { return ark::detail::tracked_malloc(size); }
+void* operator new[](std::size_t size) { return ark::detail::tracked_malloc(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return ark::detail::tracked_aligned_malloc(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return ark::detail::tracked_aligned_malloc(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+#endif
@@ -1,20 +1,36 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <bitset>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <span>
+#include <string>
 #include <thread>
 #include <tuple>
+#include <utility>
 
+#include "ark/allocation_tracking.hpp"
 #include "ark/flat_entity_set.hpp"
 #include "ark/flat_hash_map.hpp"
+#include "ark/frame_arena.hpp"
+#include "ark/memory_report.hpp"
+#include "ark/memory_resource.hpp"
+#include "ark/numa.hpp"
 #include "ark/prelude.hpp"
+#include "ark/replication.hpp"
 #include "ark/resource.hpp"
+#include "ark/snapshot.hpp"
+#include "ark/stats.hpp"
 #include "ark/storage/bucket_array.hpp"
 #include "ark/system.hpp"
-#include "ark/third_party/ThreadPool.hpp"
+#include "ark/thread_pool.hpp"
+#include "ark/thread_pool_stats.hpp"
 
 using namespace std::chrono;
 
@@ -32,85 +48,159 @@ class World {
     // Compile-time evaluated type indices for systems, components and resources
 
     template <System T>
-    inline constexpr size_t system_index(void)
+    static constexpr size_t system_index(void)
     {
         return type_list::index<T, AllSystems>();
     }
 
     template <Component T>
-    inline constexpr size_t component_index(void)
+    static constexpr size_t component_index(void)
     {
         return type_list::index<T, AllComponents>();
     }
 
     template <typename T>
-    inline constexpr size_t resource_index(void)
+    static constexpr size_t resource_index(void)
     {
         return type_list::index<T, AllResources>();
     }
 
     // ------------------------------------------------------------------------------------
 
+    // Backs storages moved to it with set_memory_resource(arena_resource()), so it is
+    // declared first in order to outlive them.
+    ArenaResource m_arena;
+
     // TODO: Both ComponentStash and ResourceStash are very shallow classes.
     // Simply remove them and implement their behavior inline here in ark::World.
     ComponentStash<AllComponents> m_component_stash;
     ResourceStash<AllResources> m_resource_stash;
 
+    // For each active entity we retain a bitmask for quickly determining whether
+    // or not each individual entity has a particular component attached (1) or not (0).
+    // Which bit corresponds to which component is determined at compile time by the order of
+    // components in the AllComponents template argument to ark::World.
+    // The primary use-case of this bitmask is to notify any relevant systems upon entity
+    // creation/destruction when the new entity's component bitmask matches the system's set
+    // of followed components, which is also represented as a bitmask. This allows us to use
+    // a single bitwise AND operation per system to determine if an entity is followed or not.
+    // example: bool is_followed = (system_mask & entity_mask) == system_mask.
+
+    using ComponentMask = TypeMask<AllComponents>;
+    EntityMap<ComponentMask> m_entity_masks;
+
+    template <System T>
+    static constexpr ComponentMask system_mask(void)
+    {
+        return ComponentMask(typename T::Subscriptions());
+    }
+
     // ------------------------------------------------------------------------------------
     // System information
 
-    std::array<FlatEntitySet, AllSystems::size> m_followed;
+    // Followed entity sets are shared between all systems with identical Subscriptions.
+    // See detail::FollowGroups for how systems are grouped at compile time.
 
-    template <System T>
-    inline void follow_new_entities(const std::vector<EntityID>& entities)
+    using FollowGroups = detail::FollowGroups<AllComponents, AllSystems>;
+    using FollowGroupIndices = std::make_index_sequence<FollowGroups::num_groups>;
+
+    std::array<FlatEntitySet, FollowGroups::num_groups> m_followed;
+
+    template <size_t G>
+    static constexpr ComponentMask group_mask(void)
     {
-        ARK_LOG_VERBOSE(detail::type_name<T>()
-                        << " following new entities: " << entities_to_string(entities));
-        m_followed[system_index<T>()].insert_new_entities(entities);
+        return FollowGroups::group_masks[G];
     }
 
-    template <System T>
-    inline void follow_entities(const std::vector<EntityID>& entities)
+    template <size_t G>
+    inline void follow_entities(std::span<const EntityID> entities)
     {
-        ARK_LOG_VERBOSE(detail::type_name<T>()
+        ARK_LOG_VERBOSE("follow group " << G
                         << " following entities: " << entities_to_string(entities));
-        m_followed[system_index<T>()].insert_entities(entities);
+        m_followed[G].insert_entities(entities);
     }
 
-    template <System T>
-    inline void unfollow_entities(const std::vector<EntityID>& entities)
+    template <size_t G>
+    inline void unfollow_entities(std::span<const EntityID> entities)
     {
-        ARK_LOG_VERBOSE(detail::type_name<T>()
+        ARK_LOG_VERBOSE("follow group " << G
                         << " unfollowing entities: " << entities_to_string(entities));
-        m_followed[system_index<T>()].remove_entities(entities);
+        m_followed[G].remove_entities(entities);
     }
 
     template <System T>
-    inline FollowedEntities get_followed_entities(void)
+    inline FlatEntitySet& followed_set(void)
     {
-        return FollowedEntities(std::addressof(m_followed[system_index<T>()]), &m_thread_pool);
+        return m_followed[FollowGroups::template group_of<T>()];
     }
 
-    // ------------------------------------------------------------------------------------
+    // Capacity requested through World::reserve and World::reserve<T>. A follow group can't
+    // follow more entities than the smallest number reserved for any of its subscribed
+    // components, which is used to size its followed set.
+    size_t m_reserved_entities;
+    std::array<size_t, AllComponents::size> m_reserved_components;
 
+    template <size_t G>
+    void reserve_followed_set(void)
+    {
+        constexpr ComponentMask mask = group_mask<G>();
+
+        bool subscribes_to_any = false;
+        size_t capacity = 0;
+        for (size_t i = 0; i < AllComponents::size; i++) {
+            if (mask.check(i)) {
+                capacity = subscribes_to_any ? std::min(capacity, m_reserved_components[i])
+                                             : m_reserved_components[i];
+                subscribes_to_any = true;
+            }
+        }
 
-    // For each active entity we retain a bitmask for quickly determining whether
-    // or not each individual entity has a particular component attached (1) or not (0).
-    // Which bit corresponds to which component is determined at compile time by the order of
-    // components in the AllComponents template argument to ark::World.
-    // The primary use-case of this bitmask is to notify any relevant systems upon entity
-    // creation/destruction when the new entity's component bitmask matches the system's set
-    // of followed components, which is also represented as a bitmask. This allows us to use
-    // a single bitwise AND operation per system to determine if an entity is followed or not.
-    // example: bool is_followed = (system_mask & entity_mask) == system_mask.
+        m_followed[G].reserve(subscribes_to_any ? capacity : m_reserved_entities);
+    }
 
-    using ComponentMask = TypeMask<AllComponents>;
-    EntityMap<ComponentMask> m_entity_masks;
+    template <size_t... Gs>
+    inline void reserve_followed_sets(const std::index_sequence<Gs...>&)
+    {
+        (reserve_followed_set<Gs>(), ...);
+    }
 
+    // Structural changes are only queued in each followed set as they happen (see
+    // FlatEntitySet), so the set is consolidated here, right before a system iterates it.
     template <System T>
-    static constexpr ComponentMask system_mask(void)
+    inline FollowedEntities get_followed_entities(void)
     {
-        return ComponentMask(typename T::Subscriptions());
+        FlatEntitySet& followed = followed_set<T>();
+        followed.consolidate();
+        return FollowedEntities(std::addressof(followed), &m_thread_pool, &m_frame_arenas,
+                                m_deterministic_chunk_size);
+    }
+
+    // Before running a group of systems in parallel, all of their followed sets with pending
+    // changes are consolidated up front (in parallel, if there are several) so that the
+    // systems themselves only ever read them.
+    template <typename... Ts>
+    void consolidate_followed_sets(void)
+    {
+        std::array<FlatEntitySet*, sizeof...(Ts)> pending;
+        size_t num_pending = 0;
+
+        auto add_if_pending = [&](FlatEntitySet* set) {
+            const auto end = pending.begin() + num_pending;
+            if (set->has_pending_changes() && std::find(pending.begin(), end, set) == end) {
+                pending[num_pending++] = set;
+            }
+        };
+
+        (add_if_pending(std::addressof(followed_set<Ts>())), ...);
+
+        if (num_pending == 1) {
+            pending[0]->consolidate();
+        }
+        else if (num_pending > 1) {
+            m_thread_pool.parallel_for(num_pending, [&pending](size_t i) {
+                pending[i]->consolidate();
+            });
+        }
     }
 
     /* ------------------------------------------------------------------------------------
@@ -130,44 +220,74 @@ class World {
 
     size_t m_num_entities;
 
-    std::unordered_map<ComponentMask, std::vector<EntityID>> m_new_entity_roster;
+    // IDs are handed out by each World from its own counter, so that they only depend on
+    // the order entities were built in.
+    EntityID m_next_entity_id;
 
-    template <System T>
-    inline void alert_system_new_entities_created(const std::vector<EntityID>& new_entities,
-                                                  const ComponentMask& entity_mask)
+    // Rosters are never cleared, only the vectors in them, so that no allocations are made
+    // once every component mask in use has been seen at least once.
+    using Roster = std::unordered_map<ComponentMask, std::vector<EntityID>>;
+    Roster m_new_entity_roster;
+
+    // Scratch list of roster entries, see ordered_roster.
+    std::vector<typename Roster::value_type*> m_roster_order;
+
+    // The non-empty entries of 'roster', in the order of their first entity. Iterating the
+    // unordered_map itself would visit them in an order that depends on hashing and on the
+    // roster's history, which would leak into the layout of the World's tables.
+    std::span<typename Roster::value_type*> ordered_roster(Roster& roster)
+    {
+        m_roster_order.clear();
+        for (auto& entry : roster) {
+            if (!entry.second.empty()) m_roster_order.push_back(std::addressof(entry));
+        }
+        std::sort(m_roster_order.begin(), m_roster_order.end(), [](auto* a, auto* b) {
+            return a->second.front() < b->second.front();
+        });
+        return m_roster_order;
+    }
+
+    template <size_t G>
+    inline void alert_group_new_entities_created(const std::vector<EntityID>& new_entities,
+                                                 const ComponentMask& entity_mask)
     {
-        constexpr ComponentMask sys_mask = system_mask<T>();
+        constexpr ComponentMask sys_mask = group_mask<G>();
         if (sys_mask.is_subset_of(entity_mask)) {
-            follow_new_entities<T>(new_entities);
+            // Make room for the whole batch (see EntityBuilder::spawn_batch) before it is
+            // merged into the set. Growing at least geometrically keeps small batches every
+            // frame from reallocating each time.
+            FlatEntitySet& followed = m_followed[G];
+            const size_t needed =
+                followed.size() + followed.pending_count() + new_entities.size();
+            if (needed > followed.capacity()) {
+                followed.reserve(std::max(needed, 2 * followed.capacity()));
+            }
+            follow_entities<G>(new_entities);
         }
     }
 
-    template <typename... SystemTypes>
-    inline void alert_all_systems_new_entities_created(const std::vector<EntityID>& new_entities,
-                                                       const ComponentMask& entity_mask,
-                                                       const TypeList<SystemTypes...>&)
+    template <size_t... Gs>
+    inline void alert_all_groups_new_entities_created(const std::vector<EntityID>& new_entities,
+                                                      const ComponentMask& entity_mask,
+                                                      const std::index_sequence<Gs...>&)
     {
-        (alert_system_new_entities_created<SystemTypes>(new_entities, entity_mask), ...);
+        (alert_group_new_entities_created<Gs>(new_entities, entity_mask), ...);
     }
 
     void post_process_newly_created_entities(void)
     {
-        for (auto& [mask, new_entities] : m_new_entity_roster) {
-            if (!new_entities.empty()) {
-                for (const EntityID id : new_entities) {
-                    m_num_entities++;
-                    m_entity_masks.insert(id, mask);
-                }
-
-                alert_all_systems_new_entities_created(new_entities, mask, AllSystems());
-                new_entities.clear();
+        for (auto* entry : ordered_roster(m_new_entity_roster)) {
+            auto& [mask, new_entities] = *entry;
+            m_entity_masks.reserve(m_entity_masks.size() + new_entities.size());
+            for (const EntityID id : new_entities) {
+                m_num_entities++;
+                m_entity_masks.insert(id, mask);
             }
-        }
+            if constexpr (REPLICATES) m_created_history.record(m_tick, new_entities);
 
-        // TODO: If this has a non-neglible performance cost,
-        // use logic with total m_new_entity_roster memory usage
-        // and history to decide whether or not to clear.
-        m_new_entity_roster.clear();
+            alert_all_groups_new_entities_created(new_entities, mask, FollowGroupIndices());
+            new_entities.clear();
+        }
     }
 
     /* ------------------------------------------------------------------------------------
@@ -180,23 +300,24 @@ class World {
     */// ----------------------------------------------------------------------------------
 
     std::vector<EntityID> m_death_row;
+    Roster m_destroyed_roster;
 
-    template <System T>
-    inline void alert_system_entities_destroyed(const std::vector<EntityID>& destroyed_entities,
-                                                const ComponentMask& destroyed_mask)
+    template <size_t G>
+    inline void alert_group_entities_destroyed(const std::vector<EntityID>& destroyed_entities,
+                                               const ComponentMask& destroyed_mask)
     {
-        constexpr ComponentMask sys_mask = system_mask<T>();
+        constexpr ComponentMask sys_mask = group_mask<G>();
         if (sys_mask.is_subset_of(destroyed_mask)) {
-            unfollow_entities<T>(destroyed_entities);
+            unfollow_entities<G>(destroyed_entities);
         }
     }
 
-    template <typename... SystemTypes>
-    inline void alert_all_systems_entities_destroyed(
+    template <size_t... Gs>
+    inline void alert_all_groups_entities_destroyed(
         const std::vector<EntityID>& destroyed_entities, const ComponentMask& destroyed_mask,
-        const TypeList<SystemTypes...>&)
+        const std::index_sequence<Gs...>&)
     {
-        (alert_system_entities_destroyed<SystemTypes>(destroyed_entities, destroyed_mask), ...);
+        (alert_group_entities_destroyed<Gs>(destroyed_entities, destroyed_mask), ...);
     }
 
     template <Component T>
@@ -222,40 +343,34 @@ class World {
 
     void post_process_destroyed_entities(void)
     {
-		//TODO: make this non-static
-        static std::unordered_map<ComponentMask, std::vector<EntityID>> destroyed_roster;
-
         if (m_death_row.empty()) return;
 
         ARK_LOG_VERBOSE("destroying " << m_death_row.size()
                                       << " entities: " << entities_to_string(m_death_row));
 
 
-        // with the destroyed_roster we group entities by component mask and destroy them
+        // with the destroyed roster we group entities by component mask and destroy them
         // in batch, for better performance in cases where many similar entities are destroyed
         // at once.
         for (const EntityID id : m_death_row) {
             const ComponentMask mask = m_entity_masks[id];
             m_entity_masks.remove(id);
 
-            if (auto it = destroyed_roster.find(mask); it != destroyed_roster.end()) {
-                it->second.push_back(id);
-            } else {
-                destroyed_roster.emplace(mask, std::vector<EntityID>({id}));
-            }
+            m_destroyed_roster[mask].push_back(id);
 
             // alert all relevant component storage to release dead entities components
             detach_all_components(id, mask);
         }
 
+        if constexpr (REPLICATES) m_destroyed_history.record(m_tick, m_death_row);
+
         const auto dead_entity_count = m_death_row.size();
         m_death_row.clear();
 
-        for (auto& [mask, destroyed_entities] : destroyed_roster) {
-            if (!destroyed_entities.empty()) {
-                alert_all_systems_entities_destroyed(destroyed_entities, mask, AllSystems());
-                destroyed_entities.clear();
-            }
+        for (auto* entry : ordered_roster(m_destroyed_roster)) {
+            auto& [mask, destroyed_entities] = *entry;
+            alert_all_groups_entities_destroyed(destroyed_entities, mask, FollowGroupIndices());
+            destroyed_entities.clear();
         }
 
         assert(m_num_entities >= dead_entity_count);
@@ -276,27 +391,27 @@ class World {
     // m_attach_component_updates
     std::array<std::vector<EntityID>, AllComponents::size> m_detach_component_updates;
 
-    template <System SystemType, Component ComponentType>
-    void alert_system_component_detached_from_entities(const std::vector<EntityID>& entities)
+    template <Component ComponentType, size_t G>
+    void alert_group_component_detached_from_entities(const std::vector<EntityID>& entities)
     {
-        if constexpr (system_mask<SystemType>().check(component_index<ComponentType>())) {
-            unfollow_entities<SystemType>(entities);
+        if constexpr (group_mask<G>().check(component_index<ComponentType>())) {
+            unfollow_entities<G>(entities);
         }
     }
 
     // TODO: Can we combine the two methods below?
-    template <Component ComponentType, typename... SystemTypes>
-    inline void _alert_all_systems_component_detached_from_entities(
-        const std::vector<EntityID>& entities, const TypeList<SystemTypes...>&)
+    template <Component ComponentType, size_t... Gs>
+    inline void _alert_all_groups_component_detached_from_entities(
+        const std::vector<EntityID>& entities, const std::index_sequence<Gs...>&)
     {
-        (alert_system_component_detached_from_entities<ComponentType, SystemTypes>(entities), ...);
+        (alert_group_component_detached_from_entities<ComponentType, Gs>(entities), ...);
     }
 
     template <Component T>
-    inline void alert_all_systems_component_detached_from_entities(
+    inline void alert_all_groups_component_detached_from_entities(
         const std::vector<EntityID>& entities)
     {
-        _alert_all_systems_component_detached_from_entities<T>(entities, AllSystems());
+        _alert_all_groups_component_detached_from_entities<T>(entities, FollowGroupIndices());
     }
 
     template <Component T>
@@ -310,9 +425,13 @@ class World {
             entity_mask.unset(component_index<T>());
         }
 
-        // Any system that subscribed to the component that was removed must be notified
+        if constexpr (Replicable<T>) {
+            m_detached_history[component_index<T>()].record(m_tick, entities);
+        }
+
+        // Any follow group that subscribed to the component that was removed must be notified
         // to un-follow all of these entities.
-        alert_all_systems_component_detached_from_entities<T>(entities);
+        alert_all_groups_component_detached_from_entities<T>(entities);
     }
 
     template <Component T>
@@ -335,39 +454,39 @@ class World {
 
     std::array<std::vector<EntityID>, AllComponents::size> m_attach_component_updates;
 
-    template <Component ComponentType, System SystemType>
-    void alert_system_component_attached_to_entities(const std::vector<EntityID>& entities)
+    template <Component ComponentType, size_t G>
+    void alert_group_component_attached_to_entities(const std::vector<EntityID>& entities)
     {
-        if constexpr (system_mask<SystemType>().check(component_index<ComponentType>())) {
-            std::vector<EntityID> matched; // TODO: keep this buffer allocated as class member
+        if constexpr (group_mask<G>().check(component_index<ComponentType>())) {
+            ArenaVector<EntityID> matched{ArenaAllocator<EntityID>(&m_frame_arenas.local())};
             matched.reserve(entities.size());
 
-            // Even if a System's component bitmask includes the newly attached component,
+            // Even if a follow group's component bitmask includes the newly attached component,
             // we still have to check if the updated entity's bitmask matches the full
-            // set of components subscribed to by the System.
+            // set of components subscribed to by the group's systems.
             for (const EntityID id : entities) {
                 const ComponentMask& entity_mask = m_entity_masks[id];
-                if (system_mask<SystemType>().is_subset_of(entity_mask)) {
+                if (group_mask<G>().is_subset_of(entity_mask)) {
                     matched.push_back(id);
                 }
             }
-            follow_entities<SystemType>(matched);
+            follow_entities<G>(matched);
         }
     }
 
     // TODO: Can we combine the two methods below?
-    template <typename ComponentType, typename... SystemTypes>
-    inline void _alert_all_systems_component_attached_to_entities(
-        const std::vector<EntityID>& entities, const TypeList<SystemTypes...>&)
+    template <typename ComponentType, size_t... Gs>
+    inline void _alert_all_groups_component_attached_to_entities(
+        const std::vector<EntityID>& entities, const std::index_sequence<Gs...>&)
     {
-        (alert_system_component_attached_to_entities<ComponentType, SystemTypes>(entities), ...);
+        (alert_group_component_attached_to_entities<ComponentType, Gs>(entities), ...);
     }
 
     template <Component T>
-    inline void alert_all_systems_component_attached_to_entities(
+    inline void alert_all_groups_component_attached_to_entities(
         const std::vector<EntityID>& entities)
     {
-        _alert_all_systems_component_attached_to_entities<T>(entities, AllSystems());
+        _alert_all_groups_component_attached_to_entities<T>(entities, FollowGroupIndices());
     }
 
     template <Component T>
@@ -381,7 +500,11 @@ class World {
             entity_mask.set(component_index<T>());
         }
 
-        alert_all_systems_component_attached_to_entities<T>(entities);
+        if constexpr (Replicable<T>) {
+            m_changed_history[component_index<T>()].record(m_tick, entities);
+        }
+
+        alert_all_groups_component_attached_to_entities<T>(entities);
     }
 
     template <Component T>
@@ -410,7 +533,8 @@ class World {
         if constexpr (detail::is_specialization<T, ReadComponent>::value ||
                       detail::is_specialization<T, WriteComponent>::value ||
                       detail::is_specialization<T, ReadResource>::value ||
-                      detail::is_specialization<T, WriteResource>::value) {
+                      detail::is_specialization<T, WriteResource>::value ||
+                      std::is_same<T, FrameArena>::value) {
             return;
         }
         else if constexpr (std::is_same<T, EntityBuilder<AllComponents>>::value) {
@@ -441,7 +565,7 @@ class World {
     template <System S>
     inline void post_process_system_data(void)
     {
-        post_process_system_data(RunFnArgs<decltype(S::run)>::types());
+        post_process_system_data(typename RunFnArgs<decltype(S::run)>::types());
     }
 
     // ------------------------------------------------------------------------------------
@@ -455,16 +579,71 @@ class World {
     template <System S>
     void run_system(void)
     {
-        run_system<S>(RunFnArgs<decltype(S::run)>::types());
+        run_system<S>(typename RunFnArgs<decltype(S::run)>::types());
     }
 
     template <System S>
     void run_system_and_postprocess(void)
     {
+        detail::AllocationScope scope(start_counting_allocations<S>());
         run_system<S>();
         post_process_system_data<S>();
     }
 
+    template <System S>
+    static void run_system_in_parallel(World* world)
+    {
+        detail::AllocationScope scope(world->template start_counting_allocations<S>());
+        world->template run_system<S>();
+    }
+
+    template <System S>
+    void post_process_system_data_after_parallel_run(void)
+    {
+        detail::AllocationScope scope(allocation_counter<S>());
+        post_process_system_data<S>();
+    }
+
+    // ------------------------------------------------------------------------------------
+    // Allocation tracking (see ark/allocation_tracking.hpp)
+
+#ifdef ARK_TRACK_ALLOCATIONS
+    std::array<std::atomic<size_t>, AllSystems::size> m_system_allocations;
+
+    template <System S>
+    inline std::atomic<size_t>* allocation_counter(void)
+    {
+        return &m_system_allocations[system_index<S>()];
+    }
+
+    template <System S>
+    inline std::atomic<size_t>* start_counting_allocations(void)
+    {
+        m_system_allocations[system_index<S>()].store(0, std::memory_order_relaxed);
+        return allocation_counter<S>();
+    }
+
+    template <typename... SystemTypes>
+    void print_allocation_report(std::ostream& os, const TypeList<SystemTypes...>&) const
+    {
+        ((os << detail::type_name<SystemTypes>() << ": "
+             << m_system_allocations[system_index<SystemTypes>()].load() << std::endl),
+         ...);
+    }
+#else
+    template <System S>
+    inline std::atomic<size_t>* allocation_counter(void)
+    {
+        return nullptr;
+    }
+
+    template <System S>
+    inline std::atomic<size_t>* start_counting_allocations(void)
+    {
+        return nullptr;
+    }
+#endif
+
     // ------------------------------------------------------------------------------------
 
     template <typename T>
@@ -474,7 +653,8 @@ class World {
             return T(m_component_stash.template get<typename T::ComponentType>());
         }
         else if constexpr (detail::is_specialization<T, WriteComponent>::value) {
-            return T(m_component_stash.template get<typename T::ComponentType>());
+            return T(m_component_stash.template get<typename T::ComponentType>(),
+                     &m_component_writes[component_index<typename T::ComponentType>()]);
         }
         else if constexpr (detail::is_specialization<T, AttachComponent>::value) {
             return T(m_component_stash.template get<typename T::ComponentType>(),
@@ -485,7 +665,8 @@ class World {
                      &m_detach_component_updates[component_index<typename T::ComponentType>()]);
         }
         else if constexpr (std::is_same<T, EntityBuilder<AllComponents>>::value) {
-            return EntityBuilder<AllComponents>(&m_component_stash, &m_new_entity_roster);
+            return EntityBuilder<AllComponents>(&m_component_stash, &m_new_entity_roster,
+                                                &m_thread_pool, &m_next_entity_id);
         }
         else if constexpr (std::is_same<T, EntityDestroyer>::value) {
             return EntityDestroyer(&m_death_row);
@@ -496,6 +677,9 @@ class World {
         else if constexpr (detail::is_specialization<T, WriteResource>::value) {
             return T(m_resource_stash.template get<typename T::ResourceType>());
         }
+        else if constexpr (std::is_same<T, FrameArena>::value) {
+            return FrameArena(&m_frame_arenas);
+        }
         else {
             static_assert(detail::unreachable<T>::value, "Invalid system run argument type requested!");
         }
@@ -515,76 +699,1490 @@ class World {
 
     ThreadPool m_thread_pool;
 
-    template <System T>
-    inline void start_system_in_parallel(std::vector<std::future<void>>& results)
+    // Per-thread scratch memory for both systems (through the FrameArena run argument) and
+    // World internals, reset at the end of every run_systems_* call.
+    FrameArenas m_frame_arenas;
+
+    // see set_numa_placement
+    bool m_numa_placement;
+
+    // see set_deterministic, 0 when off
+    size_t m_deterministic_chunk_size;
+
+    static constexpr size_t DETERMINISTIC_CHUNK_SIZE = 4096;
+
+    // see checkpoint, created on first use
+    std::unique_ptr<World> m_checkpoint;
+
+    template <typename... Ts>
+    void _set_incremental_rehash(bool enabled, const TypeList<Ts...>&)
     {
-        results.emplace_back(m_thread_pool.enqueue([this]() { this->run_system<T>(); }));
+        (detail::set_incremental_rehash(m_component_stash.template get<Ts>(), enabled), ...);
     }
 
-public:
-    World(const World&) = delete;
-    World(World&&) = delete;
-    World& operator=(const World&) = delete;
-    World& operator=(World&&) = delete;
-    ~World(void) = default;
+    template <typename... Ts>
+    void _set_memory_resource(std::pmr::memory_resource* resource, const TypeList<Ts...>&)
+    {
+        (detail::set_memory_resource(m_component_stash.template get<Ts>(), resource), ...);
+    }
 
-    static constexpr size_t default_nthreads(void)
+    template <typename... Ts>
+    void _shrink_component_storage(const TypeList<Ts...>&)
     {
-        const int hardware = std::thread::hardware_concurrency();
-        // don't want to max out by default, to avoid locking the system
-        return (size_t)std::max(hardware - 2, 1);
+        (detail::shrink_to_fit(m_component_stash.template get<Ts>()), ...);
     }
 
-    World(size_t nthreads = default_nthreads()) : m_num_entities(0), m_thread_pool(nthreads) {}
+    template <Component T>
+    ComponentMemoryReport component_memory_report(void) const
+    {
+        ComponentMemoryReport result;
+        result.component = detail::type_name<T>();
 
-    template <typename Callable>
-    static World* init(Callable&& resource_initializer, size_t nthreads = default_nthreads())
+        const typename T::Storage* store = m_component_stash.template get<T>();
+        if constexpr (requires { store->memory_stats(); }) {
+            result.storage = store->memory_stats();
+        }
+
+        return result;
+    }
+
+    template <System S>
+    SystemMemoryReport system_memory_report(void) const
     {
-        World* new_world = new World(nthreads);
-        resource_initializer(new_world->m_resource_stash);
+        constexpr size_t group = FollowGroups::template group_of<S>();
+        const FlatEntitySet& followed = m_followed[group];
+
+        SystemMemoryReport result;
+        result.system = detail::type_name<S>();
+        result.follow_group = group;
+        result.followed = followed.size();
+        result.capacity = followed.capacity();
+        result.pending_changes = followed.pending_count();
+        result.bytes = followed.memory_usage();
+        return result;
+    }
 
-        if (new_world->validate()) {
-            return new_world;
+    template <typename... Cs, typename... Ss>
+    void _memory_report(MemoryReport& report, const TypeList<Cs...>&,
+                        const TypeList<Ss...>&) const
+    {
+        (report.components.push_back(component_memory_report<Cs>()), ...);
+        (report.systems.push_back(system_memory_report<Ss>()), ...);
+    }
+
+    template <typename... Ts>
+    void _place_component_memory(size_t part, size_t nparts, const TypeList<Ts...>&)
+    {
+        (detail::place_for_worker(m_component_stash.template get<Ts>(), part, nparts), ...);
+    }
+
+    // memory node of the CPU worker i is pinned to, or -1 if it isn't pinned
+    int worker_node(size_t i) const
+    {
+        const CpuInfo* cpu = CpuTopology::system().find(m_thread_pool.worker_cpu(i));
+        return cpu ? cpu->node : -1;
+    }
+
+    template <Component T>
+    std::optional<NumaLocality> component_numa_locality(void) const
+    {
+        const typename T::Storage* store = m_component_stash.template get<T>();
+        const size_t nparts = m_thread_pool.nthreads();
+
+        if constexpr (requires(std::vector<std::span<const std::byte>> & ranges) {
+                          store->memory_ranges(nparts, nparts, ranges);
+                      }) {
+            NumaLocality locality;
+            std::vector<std::span<const std::byte>> ranges;
+            for (size_t part = 0; part < nparts; part++) {
+                ranges.clear();
+                store->memory_ranges(part, nparts, ranges);
+                for (const std::span<const std::byte> range : ranges) {
+                    locality.add(range, worker_node(part + 1));
+                }
+            }
+            return locality;
         }
         else {
-            return nullptr;
+            return {};
         }
     }
 
     template <typename... Ts>
-    void run_systems_sequential()
+    void _numa_report(NumaReport& report, const TypeList<Ts...>&) const
     {
-        static_assert(sizeof...(Ts) > 0, "Must pass >= 1 system type to run_systems_sequential.");
-        (run_system_and_postprocess<Ts>(), ...);
+        (report.components.emplace_back(detail::type_name<Ts>(),
+                                        component_numa_locality<Ts>()),
+         ...);
     }
 
     template <typename... Ts>
-    void run_systems_parallel()
+    void _stats_report(StatsReport& report, const TypeList<Ts...>&) const
     {
-        static_assert(sizeof...(Ts) > 0, "Must pass >= 1 system type to run_systems_parallel.");
-        std::vector<std::future<void>> results;
-        results.reserve(sizeof...(Ts));
-        (start_system_in_parallel<Ts>(results), ...);
-        for (auto&& result : results) {
-            result.get();
+        (report.components.emplace_back(
+             detail::type_name<Ts>(),
+             detail::storage_counters(m_component_stash.template get<Ts>())),
+         ...);
+    }
+
+    template <typename... Ts>
+    void _reset_component_counters(const TypeList<Ts...>&)
+    {
+        (detail::reset_counters(m_component_stash.template get<Ts>()), ...);
+    }
+
+    static size_t roster_memory_usage(const Roster& roster)
+    {
+        size_t bytes = roster.bucket_count() * sizeof(void*);
+        for (const auto& [mask, entities] : roster) {
+            bytes += sizeof(std::pair<const ComponentMask, std::vector<EntityID>>) +
+                     entities.capacity() * sizeof(EntityID);
         }
-        (post_process_system_data<Ts>(), ...);
+        return bytes;
     }
 
-    template <typename T>
-    inline T* get_resource(void)
+    /* ------------------------------------------------------------------------------------
+    Maintenance
+
+    Component storages may optionally provide 'estimate_maintenance_time() ->
+    std::optional<double>', giving the expected duration in seconds of a call to
+    'maintenance()' if the storage would benefit from one (e.g. when it is fragmented or
+    mostly empty), or nothing otherwise. run_maintenance runs maintenance on as many of them
+    as fit within its time budget, then does the same for the World's own tables.
+    */// ----------------------------------------------------------------------------------
+
+    // hash maps/followed sets using less than this fraction of their capacity are shrunk
+    static constexpr double MAINTENANCE_SHRINK_THRESHOLD = 0.125;
+    static constexpr size_t MAINTENANCE_MIN_FOLLOWED_BYTES = 64 * 1024;
+
+    // Buffers only used while systems run (structural change queues and frame arenas) are
+    // sized for the busiest frame so far. Past these sizes they are released, and regrown
+    // on demand by the next frame that needs them.
+    static constexpr size_t MAINTENANCE_MAX_QUEUE_CAPACITY = 64 * 1024;
+    static constexpr size_t MAINTENANCE_MAX_ARENA_BYTES = 16 * 1024 * 1024;
+
+    static void release_if_oversized(std::vector<EntityID>& queue)
     {
-        return m_resource_stash.template get<T>();
+        if (queue.capacity() > MAINTENANCE_MAX_QUEUE_CAPACITY) {
+            std::vector<EntityID>().swap(queue);
+        }
     }
 
-    template <typename Callable>
-    inline void build_entities(Callable&& f)
+    static double seconds_since(std::chrono::steady_clock::time_point start)
     {
-        f(EntityBuilder<AllComponents>(&m_component_stash, &m_new_entity_roster));
-        post_process_newly_created_entities();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     }
 
-    inline size_t entity_count(void) const { return m_num_entities; }
+    template <Component T>
+    double maintain_component_storage(double time_left)
+    {
+        typename T::Storage* store = m_component_stash.template get<T>();
+
+        if constexpr (requires {
+                          store->estimate_maintenance_time();
+                          store->maintenance();
+                      }) {
+            const std::optional<double> predicted_time = store->estimate_maintenance_time();
+            if (predicted_time && *predicted_time < time_left) {
+                const auto start = std::chrono::steady_clock::now();
+                store->maintenance();
+                if (m_numa_placement) {
+                    // maintenance may have created or released buckets
+                    const size_t nparts = m_thread_pool.nthreads();
+                    m_thread_pool.for_each_worker([store, nparts](size_t worker) {
+                        detail::place_for_worker(store, worker - 1, nparts);
+                    });
+                }
+                return time_left - seconds_since(start);
+            }
+        }
+
+        return time_left;
+    }
+
+    template <typename... Ts>
+    double maintain_component_storage(double time_left, const TypeList<Ts...>&)
+    {
+        ((time_left = maintain_component_storage<Ts>(time_left)), ...);
+        return time_left;
+    }
+
+    double maintain_world_tables(double time_left)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        // rough costs per entry of re-hashing an EntityMap and copying a followed set
+        const double mask_estimate = 1e-8 * (double)m_entity_masks.size();
+        if (m_entity_masks.load_factor() < MAINTENANCE_SHRINK_THRESHOLD &&
+            mask_estimate < time_left) {
+            m_entity_masks.shrink_to_fit();
+        }
+
+        for (FlatEntitySet& followed : m_followed) {
+            if (1e-8 * (double)followed.size() > time_left - seconds_since(start)) continue;
+
+            // pending changes may be hiding a mass removal (and hold memory themselves)
+            followed.consolidate();
+
+            const double needed = (double)(followed.size() * sizeof(EntityID));
+            const double used = (double)followed.memory_usage();
+            if (used > (double)MAINTENANCE_MIN_FOLLOWED_BYTES &&
+                needed < MAINTENANCE_SHRINK_THRESHOLD * used) {
+                followed.shrink_to_fit();
+            }
+        }
+
+        release_if_oversized(m_death_row);
+        for (auto& [mask, entities] : m_new_entity_roster) {
+            release_if_oversized(entities);
+        }
+        for (auto& [mask, entities] : m_destroyed_roster) {
+            release_if_oversized(entities);
+        }
+        for (std::vector<EntityID>& updates : m_attach_component_updates) {
+            release_if_oversized(updates);
+        }
+        for (std::vector<EntityID>& updates : m_detach_component_updates) {
+            release_if_oversized(updates);
+        }
+
+        if (m_frame_arenas.capacity() > MAINTENANCE_MAX_ARENA_BYTES) {
+            m_frame_arenas.release();
+        }
+
+        return time_left - seconds_since(start);
+    }
+
+    // ------------------------------------------------------------------------------------
+    // Snapshots (see ark/snapshot.hpp)
+
+    static constexpr char SNAPSHOT_MAGIC[8] = "ARKSNAP";
+    static constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+    // sorted IDs of all entities with component T, for storages without bulk snapshots
+    template <Component T>
+    std::vector<EntityID> entities_with(void) const
+    {
+        std::vector<EntityID> ids;
+        m_entity_masks.for_each([&ids](EntityID id, const ComponentMask& mask) {
+            if (mask.check(component_index<T>())) ids.push_back(id);
+        });
+        ska_sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    template <typename... Ts>
+    void _write_snapshot_components(SnapshotWriter& out, const TypeList<Ts...>&) const
+    {
+        (out.write_string(detail::type_name<Ts>()), ...);
+        (out.write<uint64_t>(sizeof(Ts)), ...);
+    }
+
+    template <typename... Ts>
+    void _save_storages(SnapshotWriter& out, const TypeList<Ts...>&) const
+    {
+        (detail::save_storage(m_component_stash.template get<Ts>(), out,
+                              [this] { return entities_with<Ts>(); }),
+         ...);
+    }
+
+    template <typename... Ts>
+    bool _check_snapshot_components(SnapshotReader& in, const TypeList<Ts...>&)
+    {
+        const bool names_match = (in.expect_string(detail::type_name<Ts>()) && ...);
+        const bool sizes_match = names_match && ((in.read<uint64_t>() == sizeof(Ts)) && ...);
+        if (!sizes_match) in.fail();
+        return in.ok();
+    }
+
+    template <typename... Ts>
+    bool _load_storages(SnapshotReader& in, const TypeList<Ts...>&)
+    {
+        return (detail::load_storage(m_component_stash.template get<Ts>(), in,
+                                     [this] { return entities_with<Ts>(); }) &&
+                ...);
+    }
+
+    template <Component T>
+    void detach_component_if_loaded(const EntityID id, const ComponentMask& mask)
+    {
+        typename T::Storage* store = m_component_stash.template get<T>();
+        if (mask.check(component_index<T>()) && store->has(id)) {
+            store->detach(id);
+        }
+    }
+
+    // Drop structural changes that were queued but not processed yet, keeping their memory.
+    void clear_queued_changes(void)
+    {
+        for (auto& [mask, entities] : m_new_entity_roster) {
+            entities.clear();
+        }
+        m_death_row.clear();
+        for (std::vector<EntityID>& updates : m_attach_component_updates) {
+            updates.clear();
+        }
+        for (std::vector<EntityID>& updates : m_detach_component_updates) {
+            updates.clear();
+        }
+    }
+
+    // ------------------------------------------------------------------------------------
+    // Cloning (see clone_into)
+
+    template <Component T>
+    static void copy_component_storage(const World* source, World* destination)
+    {
+        detail::copy_storage(destination->m_component_stash.template get<T>(),
+                             source->m_component_stash.template get<T>(),
+                             [destination] { return destination->entities_with<T>(); },
+                             [source] { return source->entities_with<T>(); });
+    }
+
+    template <typename... Ts>
+    void _copy_component_storages(World& destination, const TypeList<Ts...>&) const
+    {
+        static constexpr std::array<void (*)(const World*, World*), sizeof...(Ts)> copies = {
+            &copy_component_storage<Ts>...};
+        World* other = std::addressof(destination);
+        other->m_thread_pool.parallel_for(sizeof...(Ts), [this, other](size_t i) {
+            copies[i](this, other);
+        });
+    }
+
+    // Remove every entity and all queued structural changes, leaving the World empty.
+    // Components are only detached where their storage actually has one, so that this also
+    // cleans up after a partially loaded snapshot.
+    template <typename... Ts>
+    void clear_entities(const TypeList<Ts...>&)
+    {
+        m_entity_masks.for_each([this](EntityID id, const ComponentMask& mask) {
+            (detach_component_if_loaded<Ts>(id, mask), ...);
+        });
+        m_entity_masks.clear();
+        m_num_entities = 0;
+
+        clear_queued_changes();
+        for (FlatEntitySet& followed : m_followed) {
+            followed.assign({});
+        }
+    }
+
+    // Fill every followed set from scratch, in a single pass over the entity masks.
+    template <size_t... Gs>
+    void rebuild_followed_sets(const std::index_sequence<Gs...>&)
+    {
+        std::array<std::vector<EntityID>, FollowGroups::num_groups> followed;
+        m_entity_masks.for_each([&followed](EntityID id, const ComponentMask& mask) {
+            ((group_mask<Gs>().is_subset_of(mask) ? followed[Gs].push_back(id) : void()), ...);
+        });
+
+        for (size_t i = 0; i < followed.size(); i++) {
+            ska_sort(followed[i].begin(), followed[i].end());
+            m_followed[i].assign(followed[i]);
+        }
+    }
+
+    // ------------------------------------------------------------------------------------
+    // Delta replication (see ark/replication.hpp)
+
+    static constexpr char DELTA_MAGIC[8] = "ARKDLTA";
+    static constexpr uint32_t DELTA_VERSION = 1;
+
+    // About 16 bytes per change, so 64MB of history by default, see set_delta_history_limit.
+    static constexpr size_t DEFAULT_DELTA_HISTORY_LIMIT = size_t(1) << 22;
+
+    template <typename... Ts>
+    static constexpr bool any_replicable(const TypeList<Ts...>&)
+    {
+        return (Replicable<Ts> || ...);
+    }
+
+    // Worlds without replicable components don't record any changes.
+    static constexpr bool REPLICATES = any_replicable(AllComponents());
+
+    // Incremented by every call that can change entities (run_systems_*, build_entities,
+    // apply_delta), and recorded with each change made during it.
+    uint64_t m_tick;
+
+    // All changes made after this tick are in the histories below. Deltas since earlier
+    // ticks hold the complete state of the World instead, see collect_delta.
+    uint64_t m_history_start;
+
+    // see applied_delta_tick
+    uint64_t m_applied_delta_tick;
+
+    // see set_delta_history_limit
+    size_t m_delta_history_limit;
+
+    ChangeHistory m_created_history;
+    ChangeHistory m_destroyed_history;
+
+    // Indexed by component, and only used for Replicable ones. Components that were
+    // attached count as changed.
+    std::array<ChangeLog, AllComponents::size> m_component_writes;
+    std::array<ChangeHistory, AllComponents::size> m_changed_history;
+    std::array<ChangeHistory, AllComponents::size> m_detached_history;
+
+    // scratch list for record_writes
+    std::vector<EntityID> m_written;
+
+    // A delta read by apply_delta, for one component, before any of it is applied.
+    struct ComponentDelta {
+        std::vector<EntityID> detached;
+        std::vector<EntityID> changed;
+        std::vector<std::byte> values;
+    };
+
+    static void sort_unique(std::vector<EntityID>& ids)
+    {
+        ska_sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+
+    template <typename... Ts>
+    void resize_change_logs(const TypeList<Ts...>&)
+    {
+        ((Replicable<Ts> ? m_component_writes[component_index<Ts>()].resize(m_thread_pool)
+                         : void()),
+         ...);
+    }
+
+    // Move the entities written through WriteComponent<T> during the current tick to T's
+    // history, once each.
+    template <Component T>
+    void record_writes(void)
+    {
+        if constexpr (Replicable<T>) {
+            m_written.clear();
+            m_component_writes[component_index<T>()].drain(m_written);
+            sort_unique(m_written);
+            m_changed_history[component_index<T>()].record(m_tick, m_written);
+        }
+    }
+
+    template <typename... Ts>
+    inline void record_component_writes(const TypeList<Ts...>&)
+    {
+        (record_writes<Ts>(), ...);
+    }
+
+    // number of changes recorded after 'tick', in all histories
+    size_t delta_history_entries_after(uint64_t tick) const
+    {
+        size_t count = m_created_history.count_after(tick) +
+                       m_destroyed_history.count_after(tick);
+        for (size_t i = 0; i < AllComponents::size; i++) {
+            count += m_changed_history[i].count_after(tick) +
+                     m_detached_history[i].count_after(tick);
+        }
+        return count;
+    }
+
+    // Called after each tick. Once the histories hold more than m_delta_history_limit
+    // changes, discard the oldest ticks until at most 3/4 of the limit remain, so that
+    // trimming happens rarely rather than a little every tick. Receivers that are further
+    // behind get a complete delta, see collect_delta.
+    void trim_delta_history(void)
+    {
+        if constexpr (REPLICATES) {
+            if (delta_history_entries_after(m_history_start) <= m_delta_history_limit) return;
+
+            // the oldest tick after which few enough changes remain
+            const size_t target = m_delta_history_limit / 4 * 3;
+            uint64_t low = m_history_start;
+            uint64_t high = m_tick;
+            while (low < high) {
+                const uint64_t middle = low + (high - low) / 2;
+                if (delta_history_entries_after(middle) <= target) high = middle;
+                else low = middle + 1;
+            }
+            discard_delta_history(low);
+        }
+    }
+
+    // Forget all recorded changes after the World's entities were replaced wholesale, so that
+    // the next delta for any receiver holds the complete state.
+    void restart_delta_history(void)
+    {
+        m_tick++;
+        m_history_start = m_tick;
+
+        m_created_history.clear();
+        m_destroyed_history.clear();
+        for (size_t i = 0; i < AllComponents::size; i++) {
+            m_component_writes[i].clear();
+            m_changed_history[i].clear();
+            m_detached_history[i].clear();
+        }
+    }
+
+    // Identifies every component by index, name, size and whether it is replicable, so that
+    // a delta is only ever applied to a World of the same type. Component masks in a delta
+    // are indexed by position in AllComponents, so the order of all components matters, not
+    // only that of the replicable ones.
+    template <typename... Ts>
+    static uint64_t delta_fingerprint(const TypeList<Ts...>&)
+    {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+        const auto add = [&hash](const void* data, size_t size) {
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 1099511628211ull;
+            }
+        };
+        const auto add_component = [&add](uint64_t index, std::string_view name,
+                                          uint64_t size, uint8_t replicable) {
+            add(&index, sizeof(index));
+            add(name.data(), name.size());
+            add(&size, sizeof(size));
+            add(&replicable, sizeof(replicable));
+        };
+        (add_component(component_index<Ts>(), detail::type_name<Ts>(), sizeof(Ts),
+                       Replicable<Ts>),
+         ...);
+        return hash;
+    }
+
+    template <typename... Ts>
+    static ComponentMask replicable_part(const ComponentMask& mask, const TypeList<Ts...>&)
+    {
+        ComponentMask result;
+        ((Replicable<Ts> && mask.check(component_index<Ts>())
+              ? result.set(component_index<Ts>())
+              : void()),
+         ...);
+        return result;
+    }
+
+    static void write_ids(SnapshotWriter& out, const std::vector<EntityID>& ids)
+    {
+        out.write<uint64_t>(ids.size());
+        out.write_array(ids.data(), ids.size());
+    }
+
+    static void read_ids(SnapshotReader& in, std::vector<EntityID>& ids)
+    {
+        const uint64_t count = in.read<uint64_t>();
+        if (count > SIZE_MAX / sizeof(EntityID) || !in.can_read(count * sizeof(EntityID))) {
+            in.fail();
+            return;
+        }
+        ids.resize(count);
+        in.read_array(ids.data(), ids.size());
+    }
+
+    // Write the changes to component T since 'since_tick', or all of them for a full delta.
+    // 'created' are the entities sent whole, whose components all count as changed.
+    template <Component T>
+    void write_component_delta(SnapshotWriter& out, uint64_t since_tick, bool full,
+                               const std::vector<EntityID>& created) const
+    {
+        if constexpr (Replicable<T>) {
+            static_assert(std::is_trivially_copyable_v<T>,
+                          "replicable components must be trivially copyable");
+            constexpr size_t index = component_index<T>();
+
+            std::vector<EntityID> detached;
+            std::vector<EntityID> changed;
+            if (full) {
+                changed = entities_with<T>();
+            }
+            else {
+                m_detached_history[index].changed_since(since_tick, detached);
+                m_changed_history[index].changed_since(since_tick, changed);
+                changed.insert(changed.end(), created.begin(), created.end());
+                sort_unique(detached);
+                sort_unique(changed);
+
+                // only what the entities have now matters, and new entities come with masks
+                std::erase_if(detached, [&](EntityID id) {
+                    const ComponentMask* mask = m_entity_masks.lookup(id);
+                    return !mask || mask->check(index) ||
+                           std::binary_search(created.begin(), created.end(), id);
+                });
+                std::erase_if(changed, [this](EntityID id) {
+                    const ComponentMask* mask = m_entity_masks.lookup(id);
+                    return !mask || !mask->check(index);
+                });
+            }
+
+            const typename T::Storage* store = m_component_stash.template get<T>();
+            std::vector<T> values;
+            values.reserve(changed.size());
+            for (const EntityID id : changed) {
+                values.push_back(store->get(id));
+            }
+
+            write_ids(out, detached);
+            write_ids(out, changed);
+            out.write_array(values.data(), values.size());
+        }
+    }
+
+    template <typename... Ts>
+    void _write_component_deltas(SnapshotWriter& out, uint64_t since_tick, bool full,
+                                 const std::vector<EntityID>& created,
+                                 const TypeList<Ts...>&) const
+    {
+        (write_component_delta<Ts>(out, since_tick, full, created), ...);
+    }
+
+    template <Component T>
+    void read_component_delta(SnapshotReader& in, ComponentDelta& delta)
+    {
+        if constexpr (Replicable<T>) {
+            read_ids(in, delta.detached);
+            read_ids(in, delta.changed);
+
+            const size_t bytes = delta.changed.size() * sizeof(T);
+            if (!in.can_read(bytes)) {
+                in.fail();
+                return;
+            }
+            delta.values.resize(bytes);
+            in.read_bytes(delta.values.data(), bytes);
+        }
+    }
+
+    template <typename... Ts>
+    void _read_component_deltas(SnapshotReader& in,
+                                std::array<ComponentDelta, AllComponents::size>& deltas,
+                                const TypeList<Ts...>&)
+    {
+        (read_component_delta<Ts>(in, deltas[component_index<Ts>()]), ...);
+    }
+
+    // Apply the changes to component T, going through the attach/detach queues for
+    // existing entities. New entities (only in 'record_ids', sorted) get their components
+    // directly, their masks come with them.
+    template <Component T>
+    void apply_component_delta(const ComponentDelta& delta,
+                               const std::vector<EntityID>& record_ids,
+                               const std::vector<ComponentMask>& record_masks)
+    {
+        if constexpr (Replicable<T>) {
+            constexpr size_t index = component_index<T>();
+            typename T::Storage* store = m_component_stash.template get<T>();
+
+            const auto detach = [&](EntityID id) {
+                const ComponentMask* mask = m_entity_masks.lookup(id);
+                if (mask && mask->check(index)) {
+                    store->detach(id);
+                    m_detach_component_updates[index].push_back(id);
+                }
+            };
+
+            for (const EntityID id : delta.detached) {
+                detach(id);
+            }
+
+            // existing entities sent whole lose the components they no longer have
+            for (size_t i = 0; i < record_ids.size(); i++) {
+                if (!record_masks[i].check(index)) detach(record_ids[i]);
+            }
+
+            for (size_t i = 0; i < delta.changed.size(); i++) {
+                const EntityID id = delta.changed[i];
+                std::array<std::byte, sizeof(T)> bytes;
+                std::memcpy(bytes.data(), delta.values.data() + i * sizeof(T), sizeof(T));
+                const T value = std::bit_cast<T>(bytes);
+
+                if (store->has(id)) {
+                    store->get(id) = value;
+                    m_changed_history[index].record(m_tick, id);
+                }
+                else if (m_entity_masks.lookup(id)) {
+                    store->attach(id, value);
+                    m_attach_component_updates[index].push_back(id);
+                }
+                else if (std::binary_search(record_ids.begin(), record_ids.end(), id)) {
+                    store->attach(id, value);
+                }
+            }
+        }
+    }
+
+    template <typename... Ts>
+    void _apply_component_deltas(const std::array<ComponentDelta, AllComponents::size>& deltas,
+                                 const std::vector<EntityID>& record_ids,
+                                 const std::vector<ComponentMask>& record_masks,
+                                 const TypeList<Ts...>&)
+    {
+        (apply_component_delta<Ts>(deltas[component_index<Ts>()], record_ids, record_masks),
+         ...);
+    }
+
+    template <typename... Ts>
+    void post_process_replicated_components(const TypeList<Ts...>&)
+    {
+        ((Replicable<Ts> ? post_process_newly_detached_components<Ts>() : void()), ...);
+        ((Replicable<Ts> ? post_process_newly_attached_components<Ts>() : void()), ...);
+    }
+
+    // ------------------------------------------------------------------------------------
+    // Columnar import/export (see export_columns)
+
+    // entities per ThreadPool task when gathering or scattering a column
+    static constexpr size_t COLUMN_BLOCK_SIZE = 16384;
+
+    template <Component T>
+    static void gather_column(World* world, std::span<const EntityID> ids, void* column,
+                              size_t offset)
+    {
+        detail::gather(world->m_component_stash.template get<T>(), ids,
+                       static_cast<T*>(column) + offset);
+    }
+
+    template <Component T>
+    static void scatter_column(World* world, std::span<const EntityID> ids, const void* column,
+                               size_t offset)
+    {
+        detail::scatter(world->m_component_stash.template get<T>(), ids,
+                        static_cast<const T*>(column) + offset);
+    }
+
+    template <typename Column>
+    using ColumnKernel = void (*)(World*, std::span<const EntityID>, Column, size_t);
+
+    // Run 'kernels[c](this, block, columns[c], offset)' for each column c and each block of
+    // 'ids' (starting at 'offset'), as separate tasks on the ThreadPool.
+    template <typename Column, size_t NColumns>
+    void run_column_kernels(std::span<const EntityID> ids,
+                            const std::array<ColumnKernel<Column>, NColumns>& kernels,
+                            const std::array<Column, NColumns>& columns)
+    {
+        const size_t nblocks = (ids.size() + COLUMN_BLOCK_SIZE - 1) / COLUMN_BLOCK_SIZE;
+        const auto run = [&](size_t task) {
+            const size_t column = task / nblocks;
+            const size_t offset = task % nblocks * COLUMN_BLOCK_SIZE;
+            const size_t count = std::min(COLUMN_BLOCK_SIZE, ids.size() - offset);
+            kernels[column](this, ids.subspan(offset, count), columns[column], offset);
+        };
+
+        if (nblocks * NColumns == 1) {
+            run(0);
+        }
+        else if (nblocks > 0) {
+            m_thread_pool.parallel_for(nblocks * NColumns, run);
+        }
+    }
+
+
+public:
+    World(const World&) = delete;
+    World(World&&) = delete;
+    World& operator=(const World&) = delete;
+    World& operator=(World&&) = delete;
+    ~World(void) = default;
+
+    // one worker per physical core, minus one for the main thread
+    static size_t default_nthreads(void) { return ThreadPool::default_nthreads(); }
+
+    World(size_t nthreads = default_nthreads()) : World(ThreadPoolOptions{.nthreads = nthreads})
+    {
+    }
+
+    // Configure the thread pool beyond its size, such as pinning workers to CPUs.
+    explicit World(const ThreadPoolOptions& options)
+        : m_reserved_entities(0), m_reserved_components(), m_num_entities(0),
+          m_next_entity_id(FIRST_ENTITY_ID), m_thread_pool(options),
+          m_frame_arenas(m_thread_pool), m_numa_placement(false),
+          m_deterministic_chunk_size(0), m_tick(0), m_history_start(0),
+          m_applied_delta_tick(0), m_delta_history_limit(DEFAULT_DELTA_HISTORY_LIMIT)
+    {
+        resize_change_logs(AllComponents());
+    }
+
+    template <typename Callable>
+    static World* init(Callable&& resource_initializer, size_t nthreads = default_nthreads())
+    {
+        return init(std::forward<Callable>(resource_initializer),
+                    ThreadPoolOptions{.nthreads = nthreads});
+    }
+
+    template <typename Callable>
+    static World* init(Callable&& resource_initializer, const ThreadPoolOptions& options)
+    {
+        World* new_world = new World(options);
+        resource_initializer(new_world->m_resource_stash);
+
+        if (new_world->validate()) {
+            return new_world;
+        }
+        else {
+            return nullptr;
+        }
+    }
+
+    template <typename... Ts>
+    void run_systems_sequential()
+    {
+        static_assert(sizeof...(Ts) > 0, "Must pass >= 1 system type to run_systems_sequential.");
+        m_tick++;
+        (run_system_and_postprocess<Ts>(), ...);
+        record_component_writes(AllComponents());
+        trim_delta_history();
+        m_frame_arenas.reset();
+    }
+
+    template <typename... Ts>
+    void run_systems_parallel()
+    {
+        static_assert(sizeof...(Ts) > 0, "Must pass >= 1 system type to run_systems_parallel.");
+        m_tick++;
+        consolidate_followed_sets<Ts...>();
+
+        static constexpr std::array<void (*)(World*), sizeof...(Ts)> systems = {
+            &run_system_in_parallel<Ts>...};
+        m_thread_pool.parallel_for(sizeof...(Ts), [this](size_t i) { systems[i](this); });
+
+        (post_process_system_data_after_parallel_run<Ts>(), ...);
+        record_component_writes(AllComponents());
+        trim_delta_history();
+        m_frame_arenas.reset_for_any_thread();
+    }
+
+    template <typename T>
+    inline T* get_resource(void)
+    {
+        return m_resource_stash.template get<T>();
+    }
+
+    template <typename Callable>
+    inline void build_entities(Callable&& f)
+    {
+        m_tick++;
+        f(EntityBuilder<AllComponents>(&m_component_stash, &m_new_entity_roster,
+                                       &m_thread_pool, &m_next_entity_id));
+        post_process_newly_created_entities();
+        trim_delta_history();
+    }
+
+    // Create 'count' copies of 'prefab' and return the first ID of the new block of
+    // entities, see EntityBuilder::instantiate.
+    template <Component... Ts>
+    EntityID instantiate(const Prefab<Ts...>& prefab, size_t count)
+    {
+        EntityID first = 0;
+        build_entities([&](EntityBuilder<AllComponents> builder) {
+            first = builder.instantiate(prefab, count);
+        });
+        return first;
+    }
+
+    // Make room for 'count' entities in total, so that building them doesn't repeatedly
+    // grow the World's internal tables. Followed sets of systems without subscriptions are
+    // sized accordingly.
+    void reserve(size_t count)
+    {
+        m_reserved_entities = std::max(m_reserved_entities, count);
+        m_entity_masks.reserve(count);
+        reserve_followed_sets(FollowGroupIndices());
+    }
+
+    // Make room for 'count' components of type T in total, in its storage (if the storage
+    // supports reserving, see detail::reserve) and in the followed sets of systems that could
+    // end up following that many entities.
+    template <Component T>
+    void reserve(size_t count)
+    {
+        size_t& reserved = m_reserved_components[component_index<T>()];
+        reserved = std::max(reserved, count);
+        detail::reserve(m_component_stash.template get<T>(), count);
+        reserve_followed_sets(FollowGroupIndices());
+    }
+
+    // Grow the World's internal hash tables and those of all component storages that
+    // support it incrementally, rather than rehashing them all at once inside whichever
+    // system happens to cross the load factor threshold. See EntityMap.
+    void set_incremental_rehash(bool enabled)
+    {
+        m_entity_masks.set_incremental_rehash(enabled);
+        _set_incremental_rehash(enabled, AllComponents());
+    }
+
+    // Allocate the memory of all component storages that support it (see
+    // detail::set_memory_resource) and of the World's entity mask map from 'resource', moving
+    // everything they hold now over to it. 'resource' must outlive the World and be thread
+    // safe, see ark/memory_resource.hpp for ready made ones. Must be called between frames.
+    void set_memory_resource(std::pmr::memory_resource* resource)
+    {
+        m_entity_masks.set_memory_resource(resource);
+        _set_memory_resource(resource, AllComponents());
+    }
+
+    // Same as above, for the storage of component T only.
+    template <Component T>
+    void set_memory_resource(std::pmr::memory_resource* resource)
+    {
+        detail::set_memory_resource(m_component_stash.template get<T>(), resource);
+    }
+
+    // A monotonic arena owned by this World, for use with set_memory_resource. It never
+    // frees anything before the World is destroyed, see ArenaResource.
+    inline ArenaResource* arena_resource(void) { return &m_arena; }
+
+    // Compact all component storages and release all memory that the World doesn't need for
+    // its current entities, such as the peak capacity left behind by a mass despawn. This also
+    // discards any capacity requested through 'reserve'.
+    void shrink_to_fit(void)
+    {
+        _shrink_component_storage(AllComponents());
+
+        m_entity_masks.shrink_to_fit();
+        for (FlatEntitySet& followed : m_followed) {
+            followed.shrink_to_fit();
+        }
+
+        m_new_entity_roster.clear();
+        m_destroyed_roster.clear();
+        m_roster_order.shrink_to_fit();
+        m_death_row.shrink_to_fit();
+        for (std::vector<EntityID>& updates : m_attach_component_updates) {
+            updates.shrink_to_fit();
+        }
+        for (std::vector<EntityID>& updates : m_detach_component_updates) {
+            updates.shrink_to_fit();
+        }
+
+        m_frame_arenas.release();
+
+        m_reserved_entities = 0;
+        m_reserved_components.fill(0);
+    }
+
+    // Spend up to 'allowed_time' seconds on incremental upkeep: defragmenting component
+    // storages and shrinking storages, hash maps and followed sets that have become mostly
+    // empty. Meant to be called regularly with whatever is left of the frame budget, so that
+    // memory is reclaimed gradually during idle time. Returns the time left over.
+    double run_maintenance(double allowed_time)
+    {
+        double time_left = maintain_component_storage(allowed_time, AllComponents());
+        if (time_left > 0.0) {
+            time_left = maintain_world_tables(time_left);
+        }
+        return time_left;
+    }
+
+    // Where this World's memory goes: per component storage, per system followed set, and
+    // for the World's own bookkeeping. Print it with operator<<.
+    MemoryReport memory_report(void) const
+    {
+        MemoryReport report;
+        _memory_report(report, AllComponents(), AllSystems());
+
+        WorldMemoryReport& world = report.world;
+        world.entities = m_num_entities;
+        world.entity_masks = m_entity_masks.stats();
+
+        for (const FlatEntitySet& followed : m_followed) {
+            world.followed_set_bytes += followed.memory_usage();
+        }
+
+        world.roster_bytes = roster_memory_usage(m_new_entity_roster) +
+                             roster_memory_usage(m_destroyed_roster) +
+                             m_roster_order.capacity() * sizeof(void*);
+
+        world.queue_bytes = m_death_row.capacity() * sizeof(EntityID);
+        for (const std::vector<EntityID>& updates : m_attach_component_updates) {
+            world.queue_bytes += updates.capacity() * sizeof(EntityID);
+        }
+        for (const std::vector<EntityID>& updates : m_detach_component_updates) {
+            world.queue_bytes += updates.capacity() * sizeof(EntityID);
+        }
+
+        world.frame_arena_bytes = m_frame_arenas.capacity();
+
+        world.delta_history_bytes = m_created_history.memory_usage() +
+                                    m_destroyed_history.memory_usage() +
+                                    m_written.capacity() * sizeof(EntityID);
+        for (size_t i = 0; i < AllComponents::size; i++) {
+            world.delta_history_bytes += m_component_writes[i].memory_usage() +
+                                         m_changed_history[i].memory_usage() +
+                                         m_detached_history[i].memory_usage();
+        }
+
+        return report;
+    }
+
+    // Hot path counters of every component storage, the entity mask map and all followed
+    // entity sets. Everything is zero unless ark is compiled with ARK_ENABLE_STATS.
+    StatsReport stats_report(void) const
+    {
+        StatsReport report;
+        _stats_report(report, AllComponents());
+        report.entity_masks = m_entity_masks.counters();
+        for (const FlatEntitySet& followed : m_followed) {
+            report.followed_sets += followed.counters();
+        }
+        return report;
+    }
+
+    void reset_stats(void)
+    {
+        _reset_component_counters(AllComponents());
+        m_entity_masks.reset_counters();
+        for (FlatEntitySet& followed : m_followed) {
+            followed.reset_counters();
+        }
+        m_thread_pool.reset_stats();
+    }
+
+    // NUMA placement, see ark/numa.hpp: each worker relocates the part of every component
+    // storage it iterates into memory on its own node. Parts that were already placed are
+    // left alone, so calling this again only moves memory allocated since. Must be called
+    // between frames, while no systems are running.
+    void place_component_memory(void)
+    {
+        const size_t nparts = m_thread_pool.nthreads();
+        m_thread_pool.for_each_worker([this, nparts](size_t worker) {
+            _place_component_memory(worker - 1, nparts, AllComponents());
+        });
+    }
+
+    // Also re-place each component storage whenever run_maintenance reorganizes it.
+    inline void set_numa_placement(bool enabled) { m_numa_placement = enabled; }
+
+    // How much of each storage's memory lives on the node of the worker iterating it.
+    NumaReport numa_report(void) const
+    {
+        NumaReport report;
+        _numa_report(report, AllComponents());
+        return report;
+    }
+
+    // Deterministic mode, for lockstep simulations and replays that need bit identical
+    // results on any machine: parallel operations on followed entities (for_each_par,
+    // for_each_par_reduce, ...) split them into chunks of 'chunk_size' entities instead of
+    // one chunk per thread, so reductions combine the same partials in the same order no
+    // matter how many threads the pool has. Entity IDs and the processing of structural
+    // changes are deterministic either way. Systems run with run_systems_parallel must still
+    // not build or destroy entities concurrently.
+    void set_deterministic(bool enabled, size_t chunk_size = DETERMINISTIC_CHUNK_SIZE)
+    {
+        ARK_ASSERT(chunk_size > 0, "World::set_deterministic: chunk size must be positive");
+        m_deterministic_chunk_size = enabled ? chunk_size : 0;
+    }
+
+    inline bool deterministic(void) const { return m_deterministic_chunk_size > 0; }
+
+    // Make 'destination' an exact copy of this World's entities, components and followed sets.
+    // Resources, the thread pool and settings such as set_deterministic are left alone.
+    // Memory that 'destination' already has is reused where possible, so that cloning into
+    // the same World again and again (e.g. a ring of Worlds holding the last frames for
+    // rollback) doesn't allocate once the sizes have settled. Storages that provide an
+    // optional 'copy_from' (see detail::copy_storage) are copied in bulk, all storages in
+    // parallel on the destination's ThreadPool. Must be called between frames.
+    void clone_into(World& destination) const
+    {
+        if (std::addressof(destination) == this) return;
+
+        _copy_component_storages(destination, AllComponents());
+
+        destination.m_entity_masks.copy_from(m_entity_masks);
+        destination.m_num_entities = m_num_entities;
+        destination.m_next_entity_id = m_next_entity_id;
+        for (size_t i = 0; i < m_followed.size(); i++) {
+            destination.m_followed[i].copy_from(m_followed[i]);
+        }
+
+        destination.clear_queued_changes();
+        destination.restart_delta_history();
+    }
+
+    // A new World with a copy of this one's entities and components, see clone_into.
+    // Components in PagedStorage are shared with this World copy-on-write, so the fork only
+    // pays for the pages either World modifies afterwards; other storages are copied in
+    // full. Resources aren't copied: they are set up by 'resource_initializer', as in init.
+    // Returns nullptr if that leaves any resource uninitialized.
+    template <typename Callable>
+    World* fork(Callable&& resource_initializer,
+                const ThreadPoolOptions& options = ThreadPoolOptions{.nthreads = 1}) const
+    {
+        World* forked = init(std::forward<Callable>(resource_initializer), options);
+        if (forked) clone_into(*forked);
+        return forked;
+    }
+
+    // Save the current state of all entities and components, to return to with rollback.
+    // Only the latest checkpoint is kept; its memory is reused by later ones, and pages of
+    // PagedStorage components are shared rather than copied.
+    void checkpoint(void)
+    {
+        if (!m_checkpoint) {
+            m_checkpoint = std::make_unique<World>(ThreadPoolOptions{.nthreads = 1});
+        }
+        clone_into(*m_checkpoint);
+    }
+
+    // Restore the state saved by the last checkpoint, which stays available for rolling
+    // back to again. Returns false if there is no checkpoint.
+    bool rollback(void)
+    {
+        if (!m_checkpoint) return false;
+        m_checkpoint->clone_into(*this);
+        return true;
+    }
+
+    // Write all entities and their components to a binary snapshot, see ark/snapshot.hpp.
+    // Resources are not included. Components must be trivially copyable. Must be called
+    // between frames. Returns false if writing failed.
+    bool save_snapshot(SnapshotWriter& out) const
+    {
+        out.write_bytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        out.write<uint32_t>(SNAPSHOT_VERSION);
+        out.write<uint32_t>(static_cast<uint32_t>(AllComponents::size));
+        _write_snapshot_components(out, AllComponents());
+        out.write<EntityID>(m_next_entity_id);
+        out.write<uint64_t>(m_num_entities);
+        m_entity_masks.save(out);
+        _save_storages(out, AllComponents());
+        return out.ok();
+    }
+
+    bool save_snapshot(std::vector<std::byte>& buffer) const
+    {
+        SnapshotWriter out(buffer);
+        return save_snapshot(out);
+    }
+
+    bool save_snapshot(const std::string& path) const
+    {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        SnapshotWriter out(file);
+        const bool saved = save_snapshot(out);
+        return std::fclose(file) == 0 && saved;
+    }
+
+    // Replace all entities of this World with those of a snapshot written by save_snapshot,
+    // and rebuild the followed sets of all systems in one pass. Must be called between
+    // frames. Returns false if the snapshot was written by a different World type or is
+    // truncated: if that is noticed while checking the header the World is left untouched,
+    // and otherwise it is left without any entities. Snapshots are trusted input, their
+    // contents aren't validated beyond that.
+    bool load_snapshot(SnapshotReader& in)
+    {
+        char magic[sizeof(SNAPSHOT_MAGIC)];
+        in.read_bytes(magic, sizeof(magic));
+        if (std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 ||
+            in.read<uint32_t>() != SNAPSHOT_VERSION ||
+            in.read<uint32_t>() != AllComponents::size) {
+            in.fail();
+        }
+        if (!in.ok() || !_check_snapshot_components(in, AllComponents())) return false;
+
+        clear_entities(AllComponents());
+        restart_delta_history();
+
+        m_next_entity_id = in.read<EntityID>();
+        m_num_entities = in.read<uint64_t>();
+        if (!m_entity_masks.load(in) || !_load_storages(in, AllComponents())) {
+            clear_entities(AllComponents());
+            return false;
+        }
+
+        rebuild_followed_sets(FollowGroupIndices());
+        return true;
+    }
+
+    bool load_snapshot(std::span<const std::byte> buffer)
+    {
+        SnapshotReader in(buffer);
+        return load_snapshot(in);
+    }
+
+    bool load_snapshot(const std::string& path)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+        SnapshotReader in(file);
+        const bool loaded = load_snapshot(in);
+        std::fclose(file);
+        return loaded;
+    }
+
+    // Incremented by every call that can change entities: run_systems_*, build_entities and
+    // apply_delta, see collect_delta.
+    inline uint64_t tick(void) const { return m_tick; }
+
+    // Write the changes made since 'since_tick' to the replicable components (see
+    // ark/replication.hpp) of this World, so that apply_delta can replay them on a World
+    // that was up to date as of 'since_tick'. Every entity is replicated, but with only its
+    // replicable components, which must be trivially copyable. The delta includes all changes
+    // up to tick(), which the receiver can check with applied_delta_tick and send back as
+    // the next 'since_tick'. Pass 0 for a complete copy. If 'since_tick' precedes the
+    // recorded history (see discard_delta_history; load_snapshot, rollback and clone_into
+    // restart it), the delta holds the complete state instead. Must be called between
+    // frames. Returns false if writing failed.
+    bool collect_delta(uint64_t since_tick, SnapshotWriter& out) const
+    {
+        const bool full = since_tick < m_history_start;
+
+        std::vector<EntityID> destroyed;
+        std::vector<EntityID> created;
+        if (full) {
+            m_entity_masks.for_each([&created](EntityID id, const ComponentMask&) {
+                created.push_back(id);
+            });
+            ska_sort(created.begin(), created.end());
+        }
+        else {
+            m_created_history.changed_since(since_tick, created);
+            m_destroyed_history.changed_since(since_tick, destroyed);
+            sort_unique(created);
+            sort_unique(destroyed);
+
+            // the receiver never saw entities that came and went since 'since_tick'
+            std::erase_if(destroyed, [&created](EntityID id) {
+                return std::binary_search(created.begin(), created.end(), id);
+            });
+            std::erase_if(created, [this](EntityID id) { return !m_entity_masks.lookup(id); });
+        }
+
+        std::vector<ComponentMask> masks;
+        masks.reserve(created.size());
+        for (const EntityID id : created) {
+            masks.push_back(replicable_part(m_entity_masks[id], AllComponents()));
+        }
+
+        out.write_bytes(DELTA_MAGIC, sizeof(DELTA_MAGIC));
+        out.write<uint32_t>(DELTA_VERSION);
+        out.write<uint64_t>(delta_fingerprint(AllComponents()));
+        out.write<uint64_t>(m_tick);
+        out.write<uint8_t>(full);
+        write_ids(out, destroyed);
+        write_ids(out, created);
+        out.write_array(masks.data(), masks.size());
+        _write_component_deltas(out, since_tick, full, created, AllComponents());
+        return out.ok();
+    }
+
+    bool collect_delta(uint64_t since_tick, std::vector<std::byte>& buffer) const
+    {
+        SnapshotWriter out(buffer);
+        return collect_delta(since_tick, out);
+    }
+
+    // Apply a delta written by collect_delta on a World of the same type: entities are
+    // created (with the same IDs) and destroyed, and replicable components attached, detached
+    // and overwritten, with followed sets updated as for changes made by systems. Components
+    // that aren't replicable are left alone, except on destroyed entities. A delta holding the
+    // complete state also destroys all entities it doesn't mention. Entities should only be
+    // created on this World through deltas, as otherwise their IDs may collide. Must be called
+    // between frames. Returns false, leaving the World untouched, if the delta was written by
+    // a different World type or is truncated. Like snapshots, deltas are otherwise trusted.
+    bool apply_delta(SnapshotReader& in)
+    {
+        char magic[sizeof(DELTA_MAGIC)];
+        in.read_bytes(magic, sizeof(magic));
+        if (std::memcmp(magic, DELTA_MAGIC, sizeof(magic)) != 0 ||
+            in.read<uint32_t>() != DELTA_VERSION ||
+            in.read<uint64_t>() != delta_fingerprint(AllComponents())) {
+            in.fail();
+        }
+        const uint64_t delta_tick = in.read<uint64_t>();
+        const bool full = in.read<uint8_t>() != 0;
+
+        std::vector<EntityID> destroyed;
+        std::vector<EntityID> record_ids;
+        std::vector<ComponentMask> record_masks;
+        read_ids(in, destroyed);
+        read_ids(in, record_ids);
+        if (in.can_read(record_ids.size() * sizeof(ComponentMask))) {
+            record_masks.resize(record_ids.size());
+            in.read_array(record_masks.data(), record_masks.size());
+        }
+        else {
+            in.fail();
+        }
+
+        std::array<ComponentDelta, AllComponents::size> components;
+        _read_component_deltas(in, components, AllComponents());
+        if (!in.ok()) return false;
+
+        m_tick++;
+
+        if (full) {
+            m_entity_masks.for_each([&](EntityID id, const ComponentMask&) {
+                if (!std::binary_search(record_ids.begin(), record_ids.end(), id)) {
+                    m_death_row.push_back(id);
+                }
+            });
+        }
+        else {
+            for (const EntityID id : destroyed) {
+                if (m_entity_masks.lookup(id)) m_death_row.push_back(id);
+            }
+        }
+        post_process_destroyed_entities();
+
+        for (size_t i = 0; i < record_ids.size(); i++) {
+            const EntityID id = record_ids[i];
+            if (!m_entity_masks.lookup(id)) {
+                m_new_entity_roster[record_masks[i]].push_back(id);
+                m_next_entity_id = std::max(m_next_entity_id, static_cast<EntityID>(id + 1));
+            }
+        }
+
+        _apply_component_deltas(components, record_ids, record_masks, AllComponents());
+        post_process_newly_created_entities();
+        post_process_replicated_components(AllComponents());
+
+        m_applied_delta_tick = delta_tick;
+        trim_delta_history();
+        return true;
+    }
+
+    bool apply_delta(std::span<const std::byte> buffer)
+    {
+        SnapshotReader in(buffer);
+        return apply_delta(in);
+    }
+
+    // The tick() of the World that collected the latest delta applied to this one.
+    inline uint64_t applied_delta_tick(void) const { return m_applied_delta_tick; }
+
+    // Forget the changes made up to and including 'up_to_tick', once all receivers have
+    // applied a delta collected at or after it. Without this the recorded history grows up
+    // to the limit set with set_delta_history_limit.
+    void discard_delta_history(uint64_t up_to_tick)
+    {
+        const uint64_t tick = std::min(up_to_tick, m_tick);
+        if (tick <= m_history_start) return;
+
+        m_history_start = tick;
+        m_created_history.discard(tick);
+        m_destroyed_history.discard(tick);
+        for (size_t i = 0; i < AllComponents::size; i++) {
+            m_changed_history[i].discard(tick);
+            m_detached_history[i].discard(tick);
+        }
+    }
+
+    // Keep at most 'max_changes' recorded changes (entities created, destroyed, or with a
+    // replicable component changed or detached, per tick) for collect_delta. Past that the
+    // oldest ticks are discarded, as with discard_delta_history, so that a World whose
+    // history is never discarded, for instance a server with no receivers, doesn't keep
+    // growing. Receivers further behind than the remaining history get a complete delta.
+    void set_delta_history_limit(size_t max_changes)
+    {
+        m_delta_history_limit = max_changes;
+        trim_delta_history();
+    }
+
+    inline size_t delta_history_limit(void) const { return m_delta_history_limit; }
+
+    // Copy the components Ts... of the entities in 'ids' to 'columns': one array per component
+    // type, in the order of 'ids'. Every entity must have all of Ts. Each column is gathered
+    // (see detail::gather) in blocks of entities that run as separate tasks on the ThreadPool.
+    // Must be called between frames.
+    template <Component... Ts>
+    void export_columns(std::span<const EntityID> ids, std::span<Ts>... columns)
+    {
+        static_assert(sizeof...(Ts) > 0, "Must pass >= 1 component type to export_columns.");
+        ARK_ASSERT(((columns.size() == ids.size()) && ...),
+                   "World::export_columns: expected one component per entity in each column");
+
+        static constexpr std::array<ColumnKernel<void*>, sizeof...(Ts)> gathers = {
+            &gather_column<Ts>...};
+        run_column_kernels(ids, gathers, std::array<void*, sizeof...(Ts)>{columns.data()...});
+    }
+
+    // The reverse of export_columns: overwrite the components Ts... of the entities in 'ids'
+    // with those in 'columns'. Every entity must have all of Ts, and appear only once.
+    // Replicable components count as written, see collect_delta.
+    template <Component... Ts>
+    void import_columns(std::span<const EntityID> ids, std::span<const Ts>... columns)
+    {
+        static_assert(sizeof...(Ts) > 0, "Must pass >= 1 component type to import_columns.");
+        ARK_ASSERT(((columns.size() == ids.size()) && ...),
+                   "World::import_columns: expected one component per entity in each column");
+
+        static constexpr std::array<ColumnKernel<const void*>, sizeof...(Ts)> scatters = {
+            &scatter_column<Ts>...};
+        m_tick++;
+        run_column_kernels(ids, scatters,
+                           std::array<const void*, sizeof...(Ts)>{columns.data()...});
+
+        ((Replicable<Ts> ? m_changed_history[component_index<Ts>()].record(m_tick, ids)
+                         : void()),
+         ...);
+        trim_delta_history();
+    }
+
+    // Call 'f(std::span<const EntityID> ids, std::span<const T> components)' on chunks of all
+    // components of type T, in no particular order. Storages that keep components in runs
+    // (bucket arrays, paged and robin hood storages, see detail::for_each_chunk) hand out
+    // their own memory, so nothing is copied. The spans are only valid during each call.
+    // Must be called between frames.
+    template <Component T, typename Callable>
+    void for_each_column_chunk(Callable&& f) const
+    {
+        detail::for_each_chunk(m_component_stash.template get<T>(), f,
+                               [this] { return entities_with<T>(); });
+    }
+
+    // Replace the contents of 'ids' and 'values' with all components of type T and the
+    // entities they belong to, copied chunk by chunk (see for_each_column_chunk).
+    template <Component T>
+    void export_column(std::vector<EntityID>& ids, std::vector<T>& values) const
+    {
+        ids.clear();
+        values.clear();
+
+        const typename T::Storage* store = m_component_stash.template get<T>();
+        if constexpr (requires { store->memory_stats(); }) {
+            const size_t count = store->memory_stats().live;
+            ids.reserve(count);
+            values.reserve(count);
+        }
+
+        for_each_column_chunk<T>(
+            [&](std::span<const EntityID> chunk_ids, std::span<const T> chunk_values) {
+                ids.insert(ids.end(), chunk_ids.begin(), chunk_ids.end());
+                values.insert(values.end(), chunk_values.begin(), chunk_values.end());
+            });
+    }
+
+    // How busy each ThreadPool thread was and how long tasks waited in the queue, also only
+    // counted with ARK_ENABLE_STATS. Print it with operator<<.
+    inline ThreadPoolStats thread_pool_stats(void) const { return m_thread_pool.stats(); }
+
+    // Record timestamped ThreadPool task events until 'stop_thread_pool_trace' is called,
+    // and dump them with 'write_thread_pool_trace'. These must be called between frames,
+    // while no systems are running.
+    inline void start_thread_pool_trace(size_t max_events_per_thread = 1 << 16)
+    {
+        m_thread_pool.start_trace(max_events_per_thread);
+    }
+
+    inline void stop_thread_pool_trace(void) { m_thread_pool.stop_trace(); }
+
+    // Write the recorded events in the Chrome trace event format, see write_chrome_trace.
+    void write_thread_pool_trace(std::ostream& os) const
+    {
+        write_chrome_trace(os, m_thread_pool.trace_events());
+    }
+
+    inline size_t entity_count(void) const { return m_num_entities; }
+
+#ifdef ARK_TRACK_ALLOCATIONS
+    // Number of heap allocations made during the most recent run of system S, including
+    // allocations made on the ThreadPool on its behalf and during World post-processing of
+    // its structural changes.
+    template <System S>
+    inline size_t allocations_last_run(void) const
+    {
+        return m_system_allocations[system_index<S>()].load();
+    }
+
+    inline void print_allocation_report(std::ostream& os) const
+    {
+        os << "heap allocations during most recent run of each system:" << std::endl;
+        print_allocation_report(os, AllSystems());
+    }
+#endif
 };
 
 }  // end namespace ark
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <concepts>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <vector>
 
 #include "ark/prelude.hpp"
+#include "ark/snapshot.hpp"
+#include "ark/stats.hpp"
 
 namespace ark {
 
@@ -26,6 +34,256 @@ concept Component =
     ComponentStorage<typename C::Storage>&& detail::Same<typename C::Storage::ComponentType, C>;
 // clang-format on
 
+namespace detail {
+
+// Attach the component 'generator(id)' to each entity in 'ids', calling the generator for
+// each of them in order.
+// Storages may optionally provide their own 'attach_all(std::span<const EntityID>, Generator&&)'
+// that does this in one batched pass (reserving space up front, etc.), which is used when
+// available. Otherwise this falls back to attaching to one entity at a time.
+template <typename Storage, typename Generator>
+void attach_all(Storage* storage, std::span<const EntityID> ids, Generator&& generator)
+{
+    if constexpr (requires { storage->attach_all(ids, generator); }) {
+        storage->attach_all(ids, generator);
+    }
+    else {
+        for (const EntityID id : ids) {
+            storage->attach(id, generator(id));
+        }
+    }
+}
+
+// Attach a copy of 'value' to each entity in 'ids'. Storages may optionally provide
+// 'attach_copies(std::span<const EntityID>, const T&)' that fills their memory directly,
+// which is used when available. Otherwise this goes through attach_all.
+template <typename Storage, typename T>
+void attach_copies(Storage* storage, std::span<const EntityID> ids, const T& value)
+{
+    if constexpr (requires { storage->attach_copies(ids, value); }) {
+        storage->attach_copies(ids, value);
+    }
+    else {
+        attach_all(storage, ids, [&value](EntityID) -> const T& { return value; });
+    }
+}
+
+// Make room in 'storage' for 'count' components in total, if the storage supports it through
+// an optional 'reserve(size_t)' method.
+template <typename Storage>
+void reserve(Storage* storage, size_t count)
+{
+    if constexpr (requires { storage->reserve(count); }) {
+        storage->reserve(count);
+    }
+}
+
+// Switch the incremental rehash mode of the hash tables used by 'storage' (see EntityMap), if
+// it has any.
+template <typename Storage>
+void set_incremental_rehash(Storage* storage, bool enabled)
+{
+    if constexpr (requires { storage->set_incremental_rehash(enabled); }) {
+        storage->set_incremental_rehash(enabled);
+    }
+}
+
+// Move 'storage' and all its future allocations over to 'resource', if it supports doing so
+// through an optional 'set_memory_resource(std::pmr::memory_resource*)' method. See
+// ark/memory_resource.hpp.
+template <typename Storage>
+void set_memory_resource(Storage* storage, std::pmr::memory_resource* resource)
+{
+    if constexpr (requires { storage->set_memory_resource(resource); }) {
+        storage->set_memory_resource(resource);
+    }
+}
+
+// Release all memory held by 'storage' that it doesn't currently need, if it supports doing
+// so through an optional 'shrink_to_fit()' method.
+template <typename Storage>
+void shrink_to_fit(Storage* storage)
+{
+    if constexpr (requires { storage->shrink_to_fit(); }) {
+        storage->shrink_to_fit();
+    }
+}
+
+// Place the memory of 'part' of 'storage' for NUMA locality, if it supports doing so through
+// an optional 'place_for_worker(part, nparts)' method. See ark/numa.hpp.
+template <typename Storage>
+void place_for_worker(Storage* storage, size_t part, size_t nparts)
+{
+    if constexpr (requires { storage->place_for_worker(part, nparts); }) {
+        storage->place_for_worker(part, nparts);
+    }
+}
+
+// Write the components in 'storage' to a snapshot (see ark/snapshot.hpp). Storages may
+// optionally provide 'save(SnapshotWriter&) const' and 'load(SnapshotReader&) -> bool' that
+// dump and restore their internal memory in bulk. Otherwise the components of the entities
+// returned by 'get_ids()' (sorted, all those that have one) are written one by one, which
+// requires the component type to be trivially copyable.
+template <typename Storage, typename GetIDs>
+void save_storage(const Storage* storage, SnapshotWriter& out, GetIDs&& get_ids)
+{
+    if constexpr (requires { storage->save(out); }) {
+        storage->save(out);
+    }
+    else {
+        using T = typename Storage::ComponentType;
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "only trivially copyable components can be saved in snapshots");
+
+        const std::vector<EntityID> ids = get_ids();
+        out.write<uint64_t>(sizeof(T));
+        out.write<uint64_t>(ids.size());
+        for (const EntityID id : ids) {
+            out.write(storage->get(id));
+        }
+    }
+}
+
+// Restore a storage written by save_storage. Without a 'load' method the storage must be
+// empty, and the components are only attached (with attach_all) once all of them were read.
+template <typename Storage, typename GetIDs>
+bool load_storage(Storage* storage, SnapshotReader& in, GetIDs&& get_ids)
+{
+    if constexpr (requires { storage->load(in); }) {
+        return storage->load(in);
+    }
+    else {
+        using T = typename Storage::ComponentType;
+        using Bytes = std::array<std::byte, sizeof(T)>;
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "only trivially copyable components can be loaded from snapshots");
+
+        const std::vector<EntityID> ids = get_ids();
+        const uint64_t component_size = in.read<uint64_t>();
+        const uint64_t count = in.read<uint64_t>();
+        if (component_size != sizeof(T) || count != ids.size()) in.fail();
+        if (!in.ok()) return false;
+
+        std::vector<Bytes> components(ids.size());
+        in.read_array(components.data(), components.size());
+        if (!in.ok()) return false;
+
+        // attach_all calls the generator for each of 'ids' in order
+        size_t next = 0;
+        attach_all(storage, std::span<const EntityID>(ids), [&](EntityID) -> T {
+            return std::bit_cast<T>(components[next++]);
+        });
+        return true;
+    }
+}
+
+// Make 'storage' a copy of 'source' (see World::clone_into). Storages may optionally provide
+// 'copy_from(const Storage&)' to do this in bulk, reusing their memory. Otherwise the
+// components of the entities returned by 'get_ids()' are detached from 'storage', and
+// copies of those of the entities returned by 'get_source_ids()' attached in their place.
+template <typename Storage, typename GetIDs, typename GetSourceIDs>
+void copy_storage(Storage* storage, const Storage* source, GetIDs&& get_ids,
+                  GetSourceIDs&& get_source_ids)
+{
+    if constexpr (requires { storage->copy_from(*source); }) {
+        storage->copy_from(*source);
+    }
+    else {
+        using T = typename Storage::ComponentType;
+        for (const EntityID id : get_ids()) {
+            storage->detach(id);
+        }
+        const std::vector<EntityID> ids = get_source_ids();
+        attach_all(storage, std::span<const EntityID>(ids),
+                   [source](EntityID id) -> const T& { return source->get(id); });
+    }
+}
+
+// Copy the components of the entities in 'ids' to 'out', in the same order (see
+// World::export_columns). Storages may optionally provide 'gather(ids, out) const' with a
+// faster kernel than looking up and copying one component at a time.
+template <typename Storage>
+void gather(const Storage* storage, std::span<const EntityID> ids,
+            typename Storage::ComponentType* out)
+{
+    if constexpr (requires { storage->gather(ids, out); }) {
+        storage->gather(ids, out);
+    }
+    else {
+        for (size_t i = 0; i < ids.size(); i++) {
+            out[i] = storage->get(ids[i]);
+        }
+    }
+}
+
+// The reverse of gather: overwrite the components of the entities in 'ids' with those in
+// 'in', using the storage's own 'scatter(ids, in)' if it has one.
+template <typename Storage>
+void scatter(Storage* storage, std::span<const EntityID> ids,
+             const typename Storage::ComponentType* in)
+{
+    if constexpr (requires { storage->scatter(ids, in); }) {
+        storage->scatter(ids, in);
+    }
+    else {
+        for (size_t i = 0; i < ids.size(); i++) {
+            storage->get(ids[i]) = in[i];
+        }
+    }
+}
+
+// Call 'f(std::span<const EntityID>, std::span<const T>)' on chunks of the components in
+// 'storage' until all were visited (see World::for_each_column_chunk). Storages may
+// optionally provide 'for_each_chunk(f)' that hands out runs of components straight from
+// their memory. Otherwise the components of the entities returned by 'get_ids()' are
+// gathered into a buffer, a block at a time.
+template <typename Storage, typename Callable, typename GetIDs>
+void for_each_chunk(const Storage* storage, Callable&& f, GetIDs&& get_ids)
+{
+    if constexpr (requires { storage->for_each_chunk(f); }) {
+        storage->for_each_chunk(f);
+    }
+    else {
+        using T = typename Storage::ComponentType;
+        constexpr size_t BLOCK_SIZE = 4096;
+
+        const std::vector<EntityID> ids = get_ids();
+        std::vector<T> values;
+        values.reserve(std::min(ids.size(), BLOCK_SIZE));
+        for (size_t begin = 0; begin < ids.size(); begin += BLOCK_SIZE) {
+            const size_t count = std::min(BLOCK_SIZE, ids.size() - begin);
+            const std::span<const EntityID> block(ids.data() + begin, count);
+            values.clear();
+            for (const EntityID id : block) {
+                values.push_back(storage->get(id));
+            }
+            f(block, std::span<const T>(values));
+        }
+    }
+}
+
+// Hot path counters of 'storage', for storages that keep them (see ark/stats.hpp).
+template <typename Storage>
+StatsSnapshot storage_counters(const Storage* storage)
+{
+    if constexpr (requires { storage->counters(); }) {
+        return storage->counters();
+    }
+    else {
+        return StatsSnapshot();
+    }
+}
+
+template <typename Storage>
+void reset_counters(Storage* storage)
+{
+    if constexpr (requires { storage->reset_counters(); }) {
+        storage->reset_counters();
+    }
+}
+
+} // namespace detail
+
 // TODO: This class is very shallow and can likely be removed and the behavior placed in-line into
 // ark::World
 template <typename AllComponents>
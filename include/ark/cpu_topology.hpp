@@ -0,0 +1,246 @@
+#pragma once
+
+#include "ark/prelude.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ark {
+
+// Where a logical CPU (hardware thread) sits in the machine.
+struct CpuInfo {
+    int cpu = 0;     // the id used by the OS, as in /sys/devices/system/cpu/cpuN
+    int core = 0;    // physical core, unique across packages
+    int package = 0; // socket
+    int node = 0;    // NUMA node
+    int smt = 0;     // index of this hardware thread among the threads of its core
+};
+
+// How ThreadPool workers are pinned to CPUs, see CpuTopology::worker_cpus.
+enum class PinningPolicy {
+    None,    // workers float freely, scheduled by the OS
+    Compact, // fill one package at a time, one worker per physical core before SMT siblings
+    Scatter, // spread workers evenly over the packages, then over the cores of each package
+};
+
+// The CPU topology of the machine, read from /sys/devices/system/cpu and .../node on Linux.
+// Elsewhere, or if that fails, every hardware thread is its own core on a single package.
+class CpuTopology {
+    std::vector<CpuInfo> m_cpus;
+    int m_num_cores;
+    int m_num_packages;
+    int m_num_nodes;
+
+    static bool read_int(const std::string& path, int& value)
+    {
+        std::ifstream file(path);
+        return (bool)(file >> value);
+    }
+
+    // parse a cpu list such as "0-3,8-11"
+    static std::vector<int> parse_cpu_list(const std::string& list)
+    {
+        std::vector<int> cpus;
+        size_t pos = 0;
+        while (pos < list.size()) {
+            int first = 0, last = 0, consumed = 0;
+            if (std::sscanf(list.c_str() + pos, "%d-%d%n", &first, &last, &consumed) != 2) {
+                if (std::sscanf(list.c_str() + pos, "%d%n", &first, &consumed) != 1) break;
+                last = first;
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+            pos += (size_t)consumed + 1; // skip the comma
+        }
+        return cpus;
+    }
+
+    // the cpu list in the file at 'path', empty if it can't be read
+    static std::vector<int> read_cpu_list(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::string list;
+        if (!std::getline(file, list)) return {};
+        return parse_cpu_list(list);
+    }
+
+    // The NUMA node of each cpu, indexed by cpu id, from the cpu list of every online node.
+    // Cpus not listed (or all of them, on machines without NUMA support) are on node 0.
+    static std::vector<int> read_cpu_nodes(void)
+    {
+        std::vector<int> cpu_nodes;
+        const std::string root = "/sys/devices/system/node/";
+        for (const int node : read_cpu_list(root + "online")) {
+            const std::string path = root + "node" + std::to_string(node) + "/cpulist";
+            for (const int cpu : read_cpu_list(path)) {
+                if ((size_t)cpu >= cpu_nodes.size()) cpu_nodes.resize((size_t)cpu + 1, 0);
+                cpu_nodes[(size_t)cpu] = node;
+            }
+        }
+        return cpu_nodes;
+    }
+
+    static std::vector<CpuInfo> read_sysfs(void)
+    {
+        std::vector<CpuInfo> cpus;
+#ifdef __linux__
+        const std::string root = "/sys/devices/system/cpu/";
+        const std::vector<int> online = read_cpu_list(root + "online");
+        const std::vector<int> cpu_nodes = read_cpu_nodes();
+
+        for (const int cpu : online) {
+            const std::string dir = root + "cpu" + std::to_string(cpu) + "/";
+            CpuInfo info;
+            info.cpu = cpu;
+            if (!read_int(dir + "topology/core_id", info.core) ||
+                !read_int(dir + "topology/physical_package_id", info.package)) {
+                return {};
+            }
+            if ((size_t)cpu < cpu_nodes.size()) info.node = cpu_nodes[(size_t)cpu];
+            cpus.push_back(info);
+        }
+#endif
+        return cpus;
+    }
+
+public:
+    CpuTopology(void) : m_cpus(read_sysfs()), m_num_cores(0), m_num_packages(0), m_num_nodes(0)
+    {
+        if (m_cpus.empty()) {
+            const int hardware = std::max((int)std::thread::hardware_concurrency(), 1);
+            for (int i = 0; i < hardware; i++) {
+                m_cpus.push_back(CpuInfo{i, i, 0, 0, 0});
+            }
+        }
+
+        // core ids are only unique within a package, so renumber them globally
+        std::sort(m_cpus.begin(), m_cpus.end(), [](const CpuInfo& a, const CpuInfo& b) {
+            if (a.package != b.package) return a.package < b.package;
+            if (a.core != b.core) return a.core < b.core;
+            return a.cpu < b.cpu;
+        });
+
+        int core = -1;
+        for (size_t i = 0; i < m_cpus.size(); i++) {
+            const bool new_core = i == 0 || m_cpus[i].package != m_cpus[i - 1].package ||
+                                  m_cpus[i].core != m_cpus[i - 1].core;
+            if (new_core) core++;
+            m_cpus[i].smt = new_core ? 0 : m_cpus[i - 1].smt + 1;
+            m_cpus[i].core = core;
+            m_num_packages = std::max(m_num_packages, m_cpus[i].package + 1);
+            m_num_nodes = std::max(m_num_nodes, m_cpus[i].node + 1);
+        }
+        m_num_cores = core + 1;
+    }
+
+    // The topology of this machine, read once.
+    static const CpuTopology& system(void)
+    {
+        static const CpuTopology topology;
+        return topology;
+    }
+
+    inline const std::vector<CpuInfo>& cpus(void) const { return m_cpus; }
+    inline size_t num_cpus(void) const { return m_cpus.size(); }
+    inline size_t num_cores(void) const { return (size_t)m_num_cores; }
+    inline size_t num_packages(void) const { return (size_t)m_num_packages; }
+    inline size_t num_nodes(void) const { return (size_t)m_num_nodes; }
+
+    const CpuInfo* find(int cpu) const
+    {
+        for (const CpuInfo& info : m_cpus) {
+            if (info.cpu == cpu) return &info;
+        }
+        return nullptr;
+    }
+
+    // The CPU to pin each of 'nworkers' pool workers to under 'policy', or nothing for
+    // PinningPolicy::None. Physical cores are always used up before SMT siblings, and
+    // when there are more workers than hardware threads, CPUs are reused round robin.
+    // The core of 'reserved_cpu' (if any), typically the one running the main thread, is
+    // only used once all other cores are.
+    std::vector<int> worker_cpus(size_t nworkers, PinningPolicy policy,
+                                 int reserved_cpu = -1) const
+    {
+        if (policy == PinningPolicy::None) return {};
+
+        std::vector<CpuInfo> order = m_cpus;
+        if (policy == PinningPolicy::Compact) {
+            std::stable_sort(order.begin(), order.end(),
+                             [](const CpuInfo& a, const CpuInfo& b) {
+                                 if (a.smt != b.smt) return a.smt < b.smt;
+                                 return a.package < b.package;
+                             });
+        }
+        else {
+            // rank of each core within its package, so that packages take turns
+            std::vector<int> rank(m_cpus.size());
+            for (size_t i = 0; i < m_cpus.size(); i++) {
+                rank[i] = 0;
+                for (size_t j = 0; j < i; j++) {
+                    if (m_cpus[j].package == m_cpus[i].package && m_cpus[j].smt == 0) {
+                        rank[i] += m_cpus[j].core != m_cpus[i].core;
+                    }
+                }
+                order[i].core = rank[i]; // only used for sorting
+            }
+            std::stable_sort(order.begin(), order.end(),
+                             [](const CpuInfo& a, const CpuInfo& b) {
+                                 if (a.smt != b.smt) return a.smt < b.smt;
+                                 if (a.core != b.core) return a.core < b.core;
+                                 return a.package < b.package;
+                             });
+        }
+
+        if (const CpuInfo* reserved = find(reserved_cpu)) {
+            const CpuInfo reserved_info = *reserved;
+            std::stable_partition(order.begin(), order.end(), [&](const CpuInfo& info) {
+                const CpuInfo* original = find(info.cpu);
+                return original->core != reserved_info.core;
+            });
+        }
+
+        std::vector<int> result(nworkers);
+        for (size_t i = 0; i < nworkers; i++) {
+            result[i] = order[i % order.size()].cpu;
+        }
+        return result;
+    }
+
+    // Restrict the calling thread to run on 'cpu' only. Returns false if that isn't
+    // supported or failed.
+    static bool pin_this_thread(int cpu)
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    // The CPU the calling thread is running on right now, or -1 if unknown.
+    static int current_cpu(void)
+    {
+#ifdef __linux__
+        return sched_getcpu();
+#else
+        return -1;
+#endif
+    }
+};
+
+} // end namespace ark
@@ -1,79 +1,185 @@
 #pragma once
 
 #include "ark/prelude.hpp"
+#include "ark/stats.hpp"
+#include "ark/third_party/skarupke/ska_sort.hpp"
 
 #include <algorithm>
+#include <span>
 #include <vector>
 
 namespace ark {
 
-namespace detail {
-
-// from https://jeaf.org/blog/inplace-set_difference/
-template <class It1, class It2>
-It1 inplace_set_difference(It1 first1, It1 last1, It2 first2, It2 last2)
-{
-    // Find the first element in range1 that is not smaller than the first
-    // element to remove
-    if (first2 != last2)
-    {
-        first1 = std::lower_bound(first1, last1, *first2);
-    }
+// A sorted set of EntityIDs followed by one or more systems.
+// Insertions and removals are not applied immediately. Instead they are queued as pending
+// changes and consolidated all at once, with a single sort and merge pass, right before the
+// set is next iterated. This way several batches of structural changes (for example from
+// multiple systems run back-to-back) only cost one merge, and sets belonging to systems that
+// aren't run for a while don't pay anything until they are.
+class FlatEntitySet {
+    std::vector<EntityID> m_entities;
 
-    // Move elements that are not in range2
-    It1 result = first1;
-    while (first1 != last1 && first2 != last2)
-    {
-        if      (*first1 < *first2) *result++ = *first1++;
-        else if (*first2 < *first1) ++first2;
-        else
-        {
-            ++first1;
-            ++first2;
-        }
-    }
+    // Each pending change is packed into 64 bits as: [ id (32) | sequence (31) | insert (1) ]
+    // so that sorting the pending changes orders them by EntityID first and by the order in
+    // which they were requested second. Only the last requested change for any EntityID is
+    // relevant when consolidating.
+    std::vector<uint64_t> m_pending;
 
-    // Copy the remaining elements, and return an iterator that points to the end
-    // of the new range
-    while (first1 != last1) *result++ = *first1++;
-    return result;
-}
+    // If the systems following this set aren't run for a long time, the pending changes are
+    // consolidated early once they outnumber the entities in the set, so they can't grow
+    // without bound.
+    static constexpr size_t MIN_EAGER_CONSOLIDATION = 4096;
 
-}
+    [[no_unique_address]] StatCounters m_stats;
+
+    static inline EntityID pending_id(uint64_t change) { return (EntityID)(change >> 32); }
+    static inline bool pending_is_insert(uint64_t change) { return change & 1; }
+
+    inline void queue_changes(std::span<const EntityID> entities, bool insert) {
+        ARK_ASSERT(m_pending.size() + entities.size() < (1ull << 31),
+                   "FlatEntitySet: too many pending changes");
+
+        m_pending.reserve(m_pending.size() + entities.size());
+        for (const EntityID id : entities) {
+            const uint64_t sequence = m_pending.size();
+            m_pending.push_back(((uint64_t)id << 32) | (sequence << 1) | (uint64_t)insert);
+        }
+
+        if (m_pending.size() > std::max(m_entities.size(), MIN_EAGER_CONSOLIDATION)) {
+            m_stats.add(Stat::SetEagerConsolidations);
+            consolidate();
+        }
+    }
 
-class FlatEntitySet {
-    std::vector<EntityID> m_entities;
 public:
     inline void reserve(size_t capacity) { m_entities.reserve(capacity); }
     inline size_t size(void) const { return m_entities.size(); }
+    inline size_t capacity(void) const { return m_entities.capacity(); }
 
-    void insert_entities(const std::vector<EntityID>& more_entities) {
-        m_entities.reserve(m_entities.size() + more_entities.size());
-
-        const size_t merge_point = m_entities.size();
+    // bytes allocated for the set and its pending changes
+    inline size_t memory_usage(void) const {
+        return m_entities.capacity() * sizeof(EntityID) + m_pending.capacity() * sizeof(uint64_t);
+    }
 
-        std::copy(more_entities.begin(), more_entities.end(), std::back_inserter(m_entities));
+    // Apply any pending changes and release all unused memory.
+    void shrink_to_fit(void) {
+        consolidate();
+        m_entities.shrink_to_fit();
+        m_pending.shrink_to_fit();
+    }
 
-        std::inplace_merge(m_entities.begin(), m_entities.begin() + merge_point, m_entities.end());
+    inline void insert_entities(std::span<const EntityID> more_entities) {
+        queue_changes(more_entities, true);
+    }
 
-        // OPTIMIZE: in principle this call is not needed, as we will never attempt to insert
-        // entities into a set that already contains them.
-        m_entities.erase(std::unique(m_entities.begin(), m_entities.end()), m_entities.end());
+    inline void remove_entities(std::span<const EntityID> entities_to_remove) {
+        queue_changes(entities_to_remove, false);
     }
 
-    void insert_new_entities(const std::vector<EntityID>& new_entities) {
-        m_entities.reserve(m_entities.size() + new_entities.size());
-        m_entities.insert(m_entities.end(), new_entities.begin(), new_entities.end());
+    // Replace the whole set with 'entities', which must be sorted and free of duplicates,
+    // dropping any pending changes.
+    void assign(std::span<const EntityID> entities) {
+        m_pending.clear();
+        m_entities.assign(entities.begin(), entities.end());
     }
 
-    void remove_entities(const std::vector<EntityID>& entities_to_remove) {
-        auto new_end = detail::inplace_set_difference(m_entities.begin(),
-                                                      m_entities.end(),
-                                                      entities_to_remove.begin(),
-                                                      entities_to_remove.end());
-        m_entities.erase(new_end, m_entities.end());
+    // Make this set a copy of 'other', pending changes included, reusing its memory.
+    void copy_from(const FlatEntitySet& other) {
+        m_entities = other.m_entities;
+        m_pending = other.m_pending;
     }
 
+    inline bool has_pending_changes(void) const { return !m_pending.empty(); }
+    inline size_t pending_count(void) const { return m_pending.size(); }
+
+    // hot path counters, only counted when ARK_ENABLE_STATS is defined
+    inline StatsSnapshot counters(void) const { return m_stats.snapshot(); }
+    inline void reset_counters(void) { m_stats.reset(); }
+
+    // Apply all pending insertions/removals. Inserting an entity already in the set or
+    // removing one that isn't are both no-ops, so the order in which the World queues
+    // structural changes doesn't matter, only the last change requested for each entity.
+    void consolidate(void) {
+        if (m_pending.empty()) return;
+
+        m_stats.add(Stat::SetConsolidations);
+        m_stats.add(Stat::SetChangesApplied, m_pending.size());
+
+        // Entities are mostly created in batches of increasing EntityIDs, in which case the
+        // pending changes are already sorted.
+        if (!std::is_sorted(m_pending.begin(), m_pending.end())) {
+            ska_sort(m_pending.begin(), m_pending.end());
+        }
+        else {
+            m_stats.add(Stat::SetSortsSkipped);
+        }
+
+        // keep only the last requested change for each entity
+        size_t num_changes = 0;
+        for (size_t i = 0; i < m_pending.size(); i++) {
+            const bool is_last = i + 1 == m_pending.size() ||
+                                 pending_id(m_pending[i + 1]) != pending_id(m_pending[i]);
+            if (is_last) {
+                m_pending[num_changes++] = m_pending[i];
+            }
+        }
+        m_pending.resize(num_changes);
+
+        // Forward pass: compact away removed entities. Insertions of entities that are
+        // already present are turned into (already satisfied) removals along the way, so the
+        // backward pass below skips them.
+        auto read = std::lower_bound(m_entities.begin(), m_entities.end(),
+                                     pending_id(m_pending.front()));
+        auto write = read;
+        auto change = m_pending.begin();
+
+        while (read != m_entities.end() && change != m_pending.end()) {
+            const EntityID changed_id = pending_id(*change);
+            if (*read < changed_id) {
+                *write++ = *read++;
+            }
+            else if (changed_id < *read) {
+                ++change;
+            }
+            else {
+                if (pending_is_insert(*change)) {
+                    *write++ = *read;
+                    *change &= ~(uint64_t)1;
+                }
+                ++read;
+                ++change;
+            }
+        }
+        write = std::copy(read, m_entities.end(), write);
+
+        const size_t remaining = write - m_entities.begin();
+        const size_t num_inserts = std::count_if(m_pending.begin(), m_pending.end(),
+                                                 [](uint64_t c) { return pending_is_insert(c); });
+
+        // Backward pass: merge the new entities in from the back, so that each existing
+        // entity is moved at most once and entities below the smallest insertion aren't
+        // touched at all.
+        m_entities.resize(remaining + num_inserts);
+
+        size_t to = remaining + num_inserts;
+        size_t from = remaining;
+        size_t c = m_pending.size();
+        while (c > 0 && to > from) {
+            const uint64_t next = m_pending[c - 1];
+            if (!pending_is_insert(next)) {
+                c--;
+            }
+            else if (from > 0 && m_entities[from - 1] > pending_id(next)) {
+                m_entities[--to] = m_entities[--from];
+            }
+            else {
+                m_entities[--to] = pending_id(next);
+                c--;
+            }
+        }
+
+        m_pending.clear();
+    }
 
     inline bool contains(EntityID id) {
         return std::binary_search(m_entities.begin(), m_entities.end(), id);
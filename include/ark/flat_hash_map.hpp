@@ -1,8 +1,18 @@
 #pragma once
 
 #include "ark/prelude.hpp"
+#include "ark/snapshot.hpp"
+#include "ark/stats.hpp"
 
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace ark {
@@ -18,98 +28,181 @@ constexpr uint32_t hash_id(EntityID id) { return 3*id; }
 
 } // end namespace ark::detail
 
+// Occupancy statistics of an EntityMap, see EntityMap::stats.
+struct EntityMapStats {
+    size_t size = 0;
+    size_t capacity = 0;
+    size_t tombstones = 0;
+    size_t longest_probe = 0;
+    double load_factor = 0.0;
+    size_t bytes = 0;
+};
+
 // An open addressing hash table using robin hood hashing
 // for mapping EntityIDs to *small types* like storage handles.
+//
+// By default, growing the table rehashes every entry at once inside the insert that crosses
+// the maximum load factor. In incremental rehash mode (see 'set_incremental_rehash') the
+// old table is instead kept alongside the new, twice as large one, and every subsequent
+// insert/remove migrates a fixed number of slots from the old table to the new one. This
+// bounds the worst case cost of any single operation, at the price of lookups probing both
+// tables while a rehash is in progress.
+//
+// Tables are allocated from a std::pmr::memory_resource, see 'set_memory_resource' and
+// ark/memory_resource.hpp.
 template <typename V>
 class EntityMap {
-    EntityID* m_keys;
-    V* m_values;
-    size_t m_count;
-    size_t m_capacity;
-    size_t m_longest_probe;
+    struct Table {
+        EntityID* keys;
+        V* values;
+        size_t count;
+        size_t capacity;
+        size_t longest_probe;
+        std::pmr::memory_resource* resource; // where the table was allocated from
+    };
+
+    // new tables are allocated from here
+    std::pmr::memory_resource* m_resource;
+
+    Table m_table;
+
+    // while an incremental rehash is in progress, the table being migrated from, and the
+    // index of the next slot in it to migrate
+    Table m_old;
+    size_t m_migration_index;
+
     double m_max_load_factor;
+    bool m_incremental_rehash;
+
+    [[no_unique_address]] StatCounters m_stats;
+
     static const EntityID EMPTY_SENTINEL = 0;
     static const EntityID TOMBSTONE_SENTINEL = 1;
 
-public:
-    EntityMap(size_t initial_capacity)
-        : m_keys( (EntityID*) malloc(sizeof(EntityID) * initial_capacity) )
-        , m_values( (V*) malloc(sizeof(V) * initial_capacity) )
-        , m_count(0)
-        , m_capacity(initial_capacity)
-        , m_longest_probe(0)
-        , m_max_load_factor(0.5)
-    {
-        ARK_ASSERT(initial_capacity > 0, "initial capacity must be greater than 0.");
-        ARK_ASSERT(detail::is_power_of_two(initial_capacity), "capacity must always be a power of two!");
-        ARK_ASSERT(m_keys, "Failed to initialize memory for EntityMap keys");
-        ARK_ASSERT(m_values, "Failed to initialize memory for EntityMap values");
+    // Number of slots of the old table migrated per insert/remove during an incremental
+    // rehash. The old table holds at most half as many entries as it has slots, and the new
+    // table has room for as many new entries as the old one has slots, so any value > 2
+    // guarantees that each incremental rehash completes before the next one is due.
+    static constexpr size_t MIGRATION_STEP = 8;
 
-        for (size_t i = 0; i < m_capacity; i++) {
-            m_keys[i] = EMPTY_SENTINEL;
-        }
+    static constexpr size_t MIN_CAPACITY = 64;
+
+    static inline bool is_live(EntityID id) {
+        return id != EMPTY_SENTINEL && id != TOMBSTONE_SENTINEL;
     }
 
-    EntityMap() : EntityMap(64) {}
+    Table allocate_table(size_t capacity) const {
+        ARK_ASSERT(capacity > 0, "initial capacity must be greater than 0.");
+        ARK_ASSERT(detail::is_power_of_two(capacity), "capacity must always be a power of two!");
 
-    EntityMap& operator=(const EntityMap&) = delete;
-    EntityMap& operator=(EntityMap&&)      = delete;
-    EntityMap(EntityMap&&)      = delete;
-    EntityMap(const EntityMap&) = delete;
+        Table table;
+        table.keys =
+            (EntityID*) m_resource->allocate(sizeof(EntityID) * capacity, alignof(EntityID));
+        table.values = (V*) m_resource->allocate(sizeof(V) * capacity, alignof(V));
+        table.count = 0;
+        table.capacity = capacity;
+        table.longest_probe = 0;
+        table.resource = m_resource;
 
-    ~EntityMap(void) {
-        for (size_t i = 0; i < m_capacity; i++) {
-            const EntityID id = m_keys[i];
-            if (id != EMPTY_SENTINEL && id != TOMBSTONE_SENTINEL) {
-                m_values[i].~V();
+        ARK_ASSERT(table.keys, "Failed to initialize memory for EntityMap keys");
+        ARK_ASSERT(table.values, "Failed to initialize memory for EntityMap values");
+
+        for (size_t i = 0; i < capacity; i++) {
+            table.keys[i] = EMPTY_SENTINEL;
+        }
+
+        return table;
+    }
+
+    static Table empty_table(void) {
+        return Table{nullptr, nullptr, 0, 0, 0, nullptr};
+    }
+
+    static void free_table(Table& table) {
+        for (size_t i = 0; i < table.capacity; i++) {
+            if (is_live(table.keys[i])) {
+                table.values[i].~V();
             }
         }
 
-        free(m_keys);
-        free(m_values);
-        m_keys = nullptr;
-        m_values = nullptr;
-        m_count = 0;
-        m_capacity = 0;
-        m_longest_probe = 0;
+        if (table.resource) {
+            table.resource->deallocate(table.keys, sizeof(EntityID) * table.capacity,
+                                       alignof(EntityID));
+            table.resource->deallocate(table.values, sizeof(V) * table.capacity, alignof(V));
+        }
+        table = empty_table();
     }
 
-    inline size_t size(void) const { return m_count; }
+    // Make 'table' a copy of 'source', reusing its memory if it has the same capacity.
+    void copy_table(Table& table, const Table& source) {
+        if (table.capacity != source.capacity) {
+            free_table(table);
+            if (source.capacity == 0) return;
+            table = allocate_table(source.capacity);
+        }
+        else if (table.capacity == 0) {
+            return;
+        }
 
-    inline double load_factor() const {
-        return static_cast<double>(m_count) / static_cast<double>(m_capacity);
+        if constexpr (std::is_trivially_copyable_v<V>) {
+            std::memcpy(table.keys, source.keys, sizeof(EntityID) * source.capacity);
+            std::memcpy(table.values, source.values, sizeof(V) * source.capacity);
+        }
+        else {
+            for (size_t i = 0; i < table.capacity; i++) {
+                if (is_live(table.keys[i])) table.values[i].~V();
+                table.keys[i] = source.keys[i];
+                if (is_live(source.keys[i])) new (&table.values[i]) V(source.values[i]);
+            }
+        }
+
+        table.count = source.count;
+        table.longest_probe = source.longest_probe;
     }
 
-    V* lookup(EntityID lookup_id) const {
-        const uint64_t N = m_capacity - 1;
+    V* table_lookup(const Table& table, EntityID lookup_id) const {
+        if (table.capacity == 0) return nullptr;
+
+        m_stats.add(Stat::MapLookups);
+
+        const uint64_t N = table.capacity - 1;
         uint32_t probe_index = detail::hash_id(lookup_id) & N;
         uint64_t distance_from_initial_bucket = 0;
 
         while (true) {
-            const EntityID probed_id = m_keys[probe_index];
+            const EntityID probed_id = table.keys[probe_index];
 
             if (probed_id == lookup_id) {
-                return m_values + probe_index;
+                return table.values + probe_index;
             } else if (probed_id == EMPTY_SENTINEL) {
                 return nullptr;
+            } else if (probed_id == TOMBSTONE_SENTINEL) {
+                m_stats.add(Stat::MapTombstonesProbed);
             }
 
             probe_index = (probe_index + 1) & N;
             distance_from_initial_bucket++;
+            m_stats.add(Stat::MapLookupProbes);
 
-            if (distance_from_initial_bucket > m_longest_probe) {
+            if (distance_from_initial_bucket > table.longest_probe) {
                 return nullptr;
             }
         }
     }
 
     template <typename... Args>
-    V* insert(EntityID new_id, Args&&... args) {
-        if (load_factor() > m_max_load_factor) {
-            rehash(m_capacity * 2);
+    V* table_insert(Table& table, EntityID new_id, Args&&... args) {
+        m_stats.add(Stat::MapInserts);
+
+        // The probe below may place the new entry in a tombstone, or displace other entries,
+        // before reaching an existing entry for the same id, so existing entries are looked
+        // up separately first.
+        if (V* existing = table_lookup(table, new_id)) {
+            *existing = V(std::forward<Args>(args)...);
+            return existing;
         }
 
-        const uint64_t N = m_capacity - 1;
+        const uint64_t N = table.capacity - 1;
         uint32_t probe_index = detail::hash_id(new_id) & N;
 
         uint64_t dib = 0; // 'd'istance from 'i'nitial 'b'ucket
@@ -117,79 +210,369 @@ public:
         V new_value(std::forward<Args>(args)...);
 
         while (true) {
-            EntityID& probed_id = m_keys[probe_index];
+            EntityID& probed_id = table.keys[probe_index];
 
             if (probed_id == TOMBSTONE_SENTINEL || probed_id == EMPTY_SENTINEL) {
                 probed_id = new_id;
-                std::swap(new_value, m_values[probe_index]);
-                m_count++;
-                m_longest_probe = dib > m_longest_probe ? dib : m_longest_probe;
-                return m_values + probe_index;
-            } else if (probed_id == new_id) {
-                std::swap(m_values[probe_index], new_value);
-                return m_values + probe_index;
+                new (table.values + probe_index) V(std::move(new_value));
+                table.count++;
+                table.longest_probe = dib > table.longest_probe ? dib : table.longest_probe;
+                return table.values + probe_index;
             } else {
-                //TODO: is this handling wrap-around properly?
-                const uint64_t probed_dib = probe_index - (detail::hash_id(probed_id) & N);
+                const uint64_t probed_dib = (probe_index - (detail::hash_id(probed_id) & N)) & N;
                 if (probed_dib < dib) {
+                    m_stats.add(Stat::MapDisplacements);
                     std::swap(probed_id, new_id);
-                    std::swap(m_values[probe_index], new_value);
-                    m_longest_probe = dib > m_longest_probe ? dib : m_longest_probe;
+                    std::swap(table.values[probe_index], new_value);
+                    table.longest_probe = dib > table.longest_probe ? dib : table.longest_probe;
                     dib = probed_dib;
                 }
             }
 
             probe_index = (probe_index + 1) & N;
             dib++;
+            m_stats.add(Stat::MapInsertProbes);
         }
     }
 
-    bool remove(EntityID id) {
-        const uint64_t N = m_capacity - 1;
+    bool table_remove(Table& table, EntityID id) {
+        if (table.capacity == 0) return false;
+
+        m_stats.add(Stat::MapRemoves);
+
+        const uint64_t N = table.capacity - 1;
         uint64_t probe_index = detail::hash_id(id) & N;
 
         uint64_t dib = 0;
 
         while (true) {
-            EntityID& probed_id = m_keys[probe_index];
+            EntityID& probed_id = table.keys[probe_index];
 
             if (probed_id == id) {
                 probed_id = TOMBSTONE_SENTINEL;
-                m_values[probe_index].~V();
-                m_count--;
+                table.values[probe_index].~V();
+                table.count--;
                 return true;
             } else if (probed_id == EMPTY_SENTINEL) {
                 return false;
+            } else if (probed_id == TOMBSTONE_SENTINEL) {
+                m_stats.add(Stat::MapTombstonesProbed);
             }
 
             probe_index = (probe_index + 1) & N;
             dib++;
 
-            if (dib > m_longest_probe) {
+            if (dib > table.longest_probe) {
                 return false;
             }
         }
     }
 
+    // Move the next 'num_slots' slots of the old table into the current one, and release the
+    // old table once it has been migrated entirely.
+    void migrate(size_t num_slots) {
+        const size_t end = std::min(m_migration_index + num_slots, m_old.capacity);
+        m_stats.add(Stat::MapSlotsMigrated, end - m_migration_index);
+
+        for (; m_migration_index < end; m_migration_index++) {
+            EntityID& id = m_old.keys[m_migration_index];
+            if (is_live(id)) {
+                table_insert(m_table, id, std::move(m_old.values[m_migration_index]));
+                m_old.values[m_migration_index].~V();
+                m_old.count--;
+                // tombstone rather than empty, so that entries further along this probe
+                // sequence can still be found in the old table
+                id = TOMBSTONE_SENTINEL;
+            }
+        }
+
+        if (m_migration_index == m_old.capacity) {
+            free_table(m_old);
+            m_migration_index = 0;
+        }
+    }
+
+    inline void finish_migration(void) {
+        if (rehash_in_progress()) {
+            migrate(m_old.capacity);
+        }
+    }
+
+    // Move to a table with 'new_capacity' slots, all at once or incrementally depending on
+    // the rehash mode.
+    void grow(size_t new_capacity) {
+        if (!m_incremental_rehash) {
+            rehash(new_capacity);
+            return;
+        }
+
+        finish_migration();
+
+        m_stats.add(Stat::MapIncrementalRehashes);
+        m_old = m_table;
+        m_table = allocate_table(new_capacity);
+        m_migration_index = 0;
+    }
+
+public:
+    EntityMap(size_t initial_capacity,
+              std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_resource(resource)
+        , m_table(allocate_table(initial_capacity))
+        , m_old(empty_table())
+        , m_migration_index(0)
+        , m_max_load_factor(0.5)
+        , m_incremental_rehash(false)
+    {
+    }
+
+    EntityMap() : EntityMap(MIN_CAPACITY) {}
+
+    EntityMap& operator=(const EntityMap&) = delete;
+    EntityMap& operator=(EntityMap&&)      = delete;
+    EntityMap(EntityMap&&)      = delete;
+    EntityMap(const EntityMap&) = delete;
+
+    ~EntityMap(void) {
+        free_table(m_table);
+        free_table(m_old);
+        m_migration_index = 0;
+    }
+
+    inline size_t size(void) const { return m_table.count + m_old.count; }
+
+    // total number of slots, including those of the old table during an incremental rehash
+    inline size_t capacity(void) const { return m_table.capacity + m_old.capacity; }
+
+    inline double load_factor() const {
+        return static_cast<double>(size()) / static_cast<double>(m_table.capacity);
+    }
+
+    inline bool rehash_in_progress(void) const { return m_old.capacity > 0; }
+
+    // hot path counters, only counted when ARK_ENABLE_STATS is defined
+    inline StatsSnapshot counters(void) const { return m_stats.snapshot(); }
+    inline void reset_counters(void) { m_stats.reset(); }
+
+    // Scans the whole table to count tombstones, so this is not meant to be called often.
+    EntityMapStats stats(void) const {
+        EntityMapStats result;
+        result.size = size();
+        result.capacity = capacity();
+        result.longest_probe = std::max(m_table.longest_probe, m_old.longest_probe);
+        result.load_factor = load_factor();
+        result.bytes = capacity() * (sizeof(EntityID) + sizeof(V));
+
+        for (const Table* table : {&m_table, &m_old}) {
+            for (size_t i = 0; i < table->capacity; i++) {
+                if (table->keys[i] == TOMBSTONE_SENTINEL) result.tombstones++;
+            }
+        }
+
+        return result;
+    }
+
+    inline std::pmr::memory_resource* memory_resource(void) const { return m_resource; }
+
+    // Allocate all tables from 'resource' from now on, moving the current entries over by
+    // rehashing them into a table of the same capacity.
+    void set_memory_resource(std::pmr::memory_resource* resource) {
+        if (resource == m_resource) return;
+        m_resource = resource;
+        rehash(m_table.capacity);
+    }
+
+    // Switch between rehashing all at once (the default) and incrementally when the table
+    // grows. Turning incremental rehashing off completes any rehash in progress.
+    void set_incremental_rehash(bool enabled) {
+        m_incremental_rehash = enabled;
+        if (!enabled) finish_migration();
+    }
+
+    V* lookup(EntityID lookup_id) const {
+        V* result = table_lookup(m_table, lookup_id);
+        if (!result && rehash_in_progress()) {
+            result = table_lookup(m_old, lookup_id);
+        }
+        return result;
+    }
+
+    template <typename... Args>
+    V* insert(EntityID new_id, Args&&... args) {
+        if (load_factor() > m_max_load_factor) {
+            grow(m_table.capacity * 2);
+        }
+
+        if (rehash_in_progress()) {
+            migrate(MIGRATION_STEP);
+            // inserting an existing id replaces its value, so drop any copy that hasn't been
+            // migrated yet
+            table_remove(m_old, new_id);
+        }
+
+        return table_insert(m_table, new_id, std::forward<Args>(args)...);
+    }
+
+    bool remove(EntityID id) {
+        if (rehash_in_progress()) {
+            migrate(MIGRATION_STEP);
+            if (table_remove(m_old, id)) return true;
+        }
+
+        return table_remove(m_table, id);
+    }
+
+    // Make room for 'count' entries in total, so that inserting up to that many entries
+    // never triggers a rehash part way through. In incremental rehash mode this only starts
+    // migrating to the larger table, like an insert crossing the maximum load factor does.
+    void reserve(size_t count) {
+        size_t new_capacity = m_table.capacity;
+        while (static_cast<double>(count) > m_max_load_factor * static_cast<double>(new_capacity)) {
+            new_capacity *= 2;
+        }
+
+        if (new_capacity > m_table.capacity) {
+            grow(new_capacity);
+        }
+    }
+
+    // Release memory after many entries have been removed, by rehashing into the smallest
+    // table that holds the current entries within the maximum load factor. This also clears
+    // out all tombstones left behind by removals.
+    void shrink_to_fit(void) {
+        size_t new_capacity = MIN_CAPACITY;
+        while (static_cast<double>(size()) > m_max_load_factor * static_cast<double>(new_capacity)) {
+            new_capacity *= 2;
+        }
+
+        if (new_capacity < m_table.capacity || rehash_in_progress()) {
+            rehash(new_capacity);
+        }
+    }
+
+    // Rehash all entries into a new table with 'new_capacity' slots, all at once.
     void rehash(size_t new_capacity) {
-        assert(new_capacity > m_capacity);
+        ARK_ASSERT(detail::is_power_of_two(new_capacity),
+                   "EntityMap: Table capacity must be a power of two!");
+        ARK_ASSERT(static_cast<double>(size()) <= m_max_load_factor * static_cast<double>(new_capacity),
+                   "EntityMap: rehash capacity too small for current entries");
+
+        m_stats.add(Stat::MapRehashes);
+        Table new_table = allocate_table(new_capacity);
+
+        for (Table* table : {&m_table, &m_old}) {
+            for (size_t i = 0; i < table->capacity; i++) {
+                if (is_live(table->keys[i])) {
+                    table_insert(new_table, table->keys[i], std::move(table->values[i]));
+                }
+            }
+            free_table(*table);
+        }
+
+        m_table = new_table;
+        m_migration_index = 0;
+    }
+
+    // Call 'f(EntityID, const V&)' for each entry, in no particular order.
+    template <typename Callable>
+    void for_each(Callable&& f) const {
+        for (const Table* table : {&m_table, &m_old}) {
+            for (size_t i = 0; i < table->capacity; i++) {
+                if (is_live(table->keys[i])) {
+                    f(table->keys[i], std::as_const(table->values[i]));
+                }
+            }
+        }
+    }
 
-        assert(detail::is_power_of_two(new_capacity) &&
-               "EntityMap: Table capacity must be a power of two!");
+    // Call 'f(std::span<const EntityID>, std::span<const V>)' for each run of consecutive
+    // occupied slots, with the keys and values in them, in no particular order.
+    template <typename Callable>
+    void for_each_run(Callable&& f) const {
+        for (const Table* table : {&m_table, &m_old}) {
+            size_t i = 0;
+            while (i < table->capacity) {
+                if (!is_live(table->keys[i])) {
+                    i++;
+                    continue;
+                }
+                const size_t start = i;
+                while (i < table->capacity && is_live(table->keys[i])) {
+                    i++;
+                }
+                f(std::span<const EntityID>(table->keys + start, i - start),
+                  std::span<const V>(table->values + start, i - start));
+            }
+        }
+    }
 
-        EntityMap new_table(new_capacity);
+    // Remove all entries and release the table, keeping only the minimum capacity.
+    void clear(void) {
+        free_table(m_table);
+        free_table(m_old);
+        m_table = allocate_table(MIN_CAPACITY);
+        m_migration_index = 0;
+    }
+
+    // Make this map an exact copy of 'other', including any incremental rehash in progress.
+    // Tables of the same capacity are copied over in place rather than reallocated.
+    void copy_from(const EntityMap& other) {
+        copy_table(m_table, other.m_table);
+        copy_table(m_old, other.m_old);
+        m_migration_index = other.m_migration_index;
+    }
+
+    // Dump the tables as they are, including any incremental rehash in progress, see
+    // ark/snapshot.hpp. Only for trivially copyable values.
+    void save(SnapshotWriter& out) const {
+        static_assert(std::is_trivially_copyable_v<V>,
+                      "EntityMap: only maps of trivially copyable values can be saved");
+
+        out.write<uint64_t>(m_migration_index);
+        for (const Table* table : {&m_table, &m_old}) {
+            out.write<uint64_t>(table->capacity);
+            out.write<uint64_t>(table->count);
+            out.write<uint64_t>(table->longest_probe);
+            out.write_array(table->keys, table->capacity);
+            out.write_live_array(table->values, table->capacity,
+                                 [table](size_t i) { return is_live(table->keys[i]); });
+        }
+    }
 
-        for (size_t i = 0; i < m_capacity; i++) {
-            EntityID id = m_keys[i];
-            if (id != EMPTY_SENTINEL && id != TOMBSTONE_SENTINEL) {
-                new_table.insert(id, std::move(m_values[i]));
+    // Replace the contents with those saved by 'save'. On failure, the map is left empty.
+    bool load(SnapshotReader& in) {
+        static_assert(std::is_trivially_copyable_v<V>,
+                      "EntityMap: only maps of trivially copyable values can be loaded");
+
+        free_table(m_table);
+        free_table(m_old);
+        m_migration_index = in.read<uint64_t>();
+
+        for (Table* table : {&m_table, &m_old}) {
+            const size_t capacity = in.read<uint64_t>();
+            const size_t count = in.read<uint64_t>();
+            const size_t longest_probe = in.read<uint64_t>();
+
+            const bool required = table == &m_table;
+            if (!in.ok() || (capacity == 0 && !required)) continue;
+            if (capacity < MIN_CAPACITY || !detail::is_power_of_two(capacity) ||
+                count > capacity) {
+                in.fail();
+                break;
             }
+
+            *table = allocate_table(capacity);
+            in.read_array(table->keys, capacity);
+            in.read_array(table->values, capacity);
+            table->count = count;
+            table->longest_probe = longest_probe;
         }
 
-        std::swap(m_keys, new_table.m_keys);
-        std::swap(m_values, new_table.m_values);
-        std::swap(m_capacity, new_table.m_capacity);
-        std::swap(m_longest_probe, new_table.m_longest_probe);
+        if (!in.ok() || m_migration_index > m_old.capacity) {
+            in.fail();
+            clear();
+        }
+        return in.ok();
     }
 
     V& operator[](EntityID id)
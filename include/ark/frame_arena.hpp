@@ -0,0 +1,253 @@
+#pragma once
+
+#include "ark/prelude.hpp"
+#include "ark/thread_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace ark {
+
+// A simple bump/linear allocator. Allocation is a pointer increment, individual allocations
+// are never freed, and everything is released at once with 'reset'.
+// When the current block runs out a new (larger) block is chained on, and on the next reset
+// all blocks are coalesced into a single block large enough for the previous peak usage. So
+// after the first few frames an arena used the same way every frame never touches the heap.
+class BumpAllocator {
+    struct Block {
+        std::byte* data;
+        size_t capacity;
+    };
+
+    static constexpr size_t BLOCK_ALIGNMENT = 64;
+    static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+    std::vector<Block> m_blocks;
+    size_t m_used; // bytes used in the last block
+
+    static Block allocate_block(size_t capacity)
+    {
+        void* data = ::operator new(capacity, std::align_val_t(BLOCK_ALIGNMENT));
+        ARK_ASSERT(data, "BumpAllocator: failed to allocate block of " << capacity << " bytes");
+        return Block{static_cast<std::byte*>(data), capacity};
+    }
+
+    static void free_block(const Block& block)
+    {
+        ::operator delete(block.data, std::align_val_t(BLOCK_ALIGNMENT));
+    }
+
+    void free_all_blocks(void)
+    {
+        for (const Block& block : m_blocks) {
+            free_block(block);
+        }
+        m_blocks.clear();
+        m_used = 0;
+    }
+
+public:
+    BumpAllocator(void) : m_blocks(), m_used(0) {}
+
+    BumpAllocator(const BumpAllocator&) = delete;
+    BumpAllocator(BumpAllocator&&) = delete;
+    BumpAllocator& operator=(const BumpAllocator&) = delete;
+    BumpAllocator& operator=(BumpAllocator&&) = delete;
+
+    ~BumpAllocator(void) { free_all_blocks(); }
+
+    void* allocate(size_t bytes, size_t alignment)
+    {
+        ARK_ASSERT((alignment & (alignment - 1)) == 0, "BumpAllocator: invalid alignment");
+
+        if (!m_blocks.empty()) {
+            const Block& block = m_blocks.back();
+            const uintptr_t begin = reinterpret_cast<uintptr_t>(block.data);
+            const uintptr_t aligned = (begin + m_used + alignment - 1) & ~(alignment - 1);
+            if (aligned + bytes <= begin + block.capacity) {
+                m_used = aligned + bytes - begin;
+                return reinterpret_cast<void*>(aligned);
+            }
+        }
+
+        const size_t previous = m_blocks.empty() ? 0 : m_blocks.back().capacity;
+        const size_t needed = bytes + alignment;
+        size_t capacity = std::max(MIN_BLOCK_SIZE, 2 * previous);
+        capacity = std::max(capacity, needed);
+
+        m_blocks.push_back(allocate_block(capacity));
+        m_used = 0;
+        return allocate(bytes, alignment);
+    }
+
+    // Release everything allocated so far. If more than one block was needed since the last
+    // reset, or if they hold less than 'min_capacity' bytes, replace them with a single block
+    // that fits all of them and at least 'min_capacity' bytes.
+    void reset(size_t min_capacity = 0)
+    {
+        const size_t total_capacity = capacity();
+        if (m_blocks.size() > 1 || total_capacity < min_capacity) {
+            free_all_blocks();
+            m_blocks.push_back(allocate_block(std::max(total_capacity, min_capacity)));
+        }
+        m_used = 0;
+    }
+
+    // Release all memory, including the block kept around for reuse by 'reset'.
+    void release(void) { free_all_blocks(); }
+
+    size_t capacity(void) const
+    {
+        size_t total_capacity = 0;
+        for (const Block& block : m_blocks) {
+            total_capacity += block.capacity;
+        }
+        return total_capacity;
+    }
+
+    // bytes handed out since the last reset, counting the unused end of every full block
+    size_t used(void) const
+    {
+        if (m_blocks.empty()) return 0;
+        return capacity() - m_blocks.back().capacity + m_used;
+    }
+};
+
+// std-compatible allocator drawing from a BumpAllocator. Deallocation is a no-op, the memory
+// is reclaimed when the arena is reset.
+template <typename T>
+class ArenaAllocator {
+    BumpAllocator* m_arena;
+
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(BumpAllocator* arena) : m_arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena())
+    {
+    }
+
+    inline T* allocate(size_t n)
+    {
+        return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    inline void deallocate(T*, size_t) {}
+
+    inline BumpAllocator* arena(void) const { return m_arena; }
+
+    template <typename U>
+    friend bool operator==(const ArenaAllocator& a, const ArenaAllocator<U>& b)
+    {
+        return a.arena() == b.arena();
+    }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// One BumpAllocator per thread that can run systems for an ark::World: the thread calling
+// run_systems_* (index 0) and each worker of the World's ThreadPool. The arenas are padded
+// to separate cache lines so that worker threads never contend with each other.
+class FrameArenas {
+    struct alignas(64) PerThreadArena {
+        BumpAllocator arena;
+    };
+
+    const ThreadPool& m_pool;
+    std::vector<PerThreadArena> m_arenas;
+
+public:
+    explicit FrameArenas(const ThreadPool& pool) : m_pool(pool), m_arenas(pool.nthreads() + 1)
+    {
+    }
+
+    FrameArenas(const FrameArenas&) = delete;
+    FrameArenas(FrameArenas&&) = delete;
+    FrameArenas& operator=(const FrameArenas&) = delete;
+    FrameArenas& operator=(FrameArenas&&) = delete;
+
+    // Threads outside the pool share index 0 with the thread calling run_systems_*, since
+    // they can only run this World's systems by calling it themselves.
+    inline BumpAllocator& local(void) { return m_arenas[m_pool.worker_index()].arena; }
+
+    void reset(void)
+    {
+        for (PerThreadArena& a : m_arenas) {
+            a.arena.reset();
+        }
+    }
+
+    // Reset after a run_systems_parallel frame. Each system ran on whichever thread picked it
+    // up, and may run on any other one next frame, so every arena is made large enough for
+    // everything allocated in this frame.
+    void reset_for_any_thread(void)
+    {
+        size_t frame_bytes = 0;
+        for (const PerThreadArena& a : m_arenas) {
+            frame_bytes += a.arena.used();
+        }
+        for (PerThreadArena& a : m_arenas) {
+            a.arena.reset(frame_bytes);
+        }
+    }
+
+    void release(void)
+    {
+        for (PerThreadArena& a : m_arenas) {
+            a.arena.release();
+        }
+    }
+
+    size_t capacity(void) const
+    {
+        size_t total_capacity = 0;
+        for (const PerThreadArena& a : m_arenas) {
+            total_capacity += a.arena.capacity();
+        }
+        return total_capacity;
+    }
+};
+
+// System run argument giving access to per-thread scratch memory. Anything allocated
+// through a FrameArena is valid until the run_systems_* call that ran the system returns,
+// at which point all arenas are reset at once.
+// Memory always comes from the arena of the calling thread, so a FrameArena is safe to use
+// from inside for_each_par. An ArenaVector should stay on the thread that created it.
+class FrameArena {
+    FrameArenas* m_arenas;
+
+public:
+    FrameArena(FrameArenas* arenas) : m_arenas(arenas) {}
+
+    // 'count' value-initialized objects of type T
+    template <typename T>
+    std::span<T> allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "FrameArena::allocate: T must be trivially destructible, as arena "
+                      "memory is released without running destructors.");
+        T* data = static_cast<T*>(m_arenas->local().allocate(count * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < count; i++) {
+            new (data + i) T();
+        }
+        return std::span<T>(data, count);
+    }
+
+    template <typename T>
+    ArenaVector<T> vector(size_t initial_capacity = 0)
+    {
+        ArenaVector<T> result{ArenaAllocator<T>(&m_arenas->local())};
+        result.reserve(initial_capacity);
+        return result;
+    }
+};
+
+} // end namespace ark
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ark/flat_hash_map.hpp"
+#include "ark/prelude.hpp"
+
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace ark {
+
+// Memory used by a single component storage. Storages report this through an optional
+// 'memory_stats()' method, see World::memory_report.
+struct StorageMemoryStats {
+    size_t live = 0;     // components currently stored
+    size_t capacity = 0; // components that fit without allocating
+
+    size_t data_bytes = 0;    // the components themselves
+    size_t key_bytes = 0;     // EntityID -> component lookup structures
+    size_t slot_id_bytes = 0; // reverse component slot -> EntityID mappings
+    size_t other_bytes = 0;   // anything else, such as scratch buffers
+
+    std::optional<double> fragmentation_factor;
+    std::optional<EntityMapStats> map;
+
+    inline size_t total_bytes(void) const
+    {
+        return data_bytes + key_bytes + slot_id_bytes + other_bytes;
+    }
+};
+
+struct ComponentMemoryReport {
+    std::string_view component;
+    // empty if the component's storage doesn't report memory usage
+    std::optional<StorageMemoryStats> storage;
+};
+
+// Systems with identical Subscriptions share a followed entity set (their 'follow group'),
+// so several systems may report the same set.
+struct SystemMemoryReport {
+    std::string_view system;
+    size_t follow_group = 0;
+    size_t followed = 0;
+    size_t capacity = 0;
+    size_t pending_changes = 0;
+    size_t bytes = 0;
+};
+
+struct WorldMemoryReport {
+    size_t entities = 0;
+    EntityMapStats entity_masks;
+    size_t followed_set_bytes = 0; // all follow groups, each counted once
+    size_t roster_bytes = 0;       // entities created/destroyed grouped by component mask
+    size_t queue_bytes = 0;        // death row and attach/detach update queues
+    size_t frame_arena_bytes = 0;
+    size_t delta_history_bytes = 0; // changes recorded for replication, see collect_delta
+
+    inline size_t total_bytes(void) const
+    {
+        return entity_masks.bytes + followed_set_bytes + roster_bytes + queue_bytes +
+               frame_arena_bytes + delta_history_bytes;
+    }
+};
+
+// A snapshot of where an ark::World's memory goes, returned by World::memory_report.
+// Byte counts are based on the capacity of each data structure, not on what the allocator
+// actually reserved for it.
+struct MemoryReport {
+    std::vector<ComponentMemoryReport> components;
+    std::vector<SystemMemoryReport> systems;
+    WorldMemoryReport world;
+
+    size_t total_bytes(void) const
+    {
+        size_t total = world.total_bytes();
+        for (const ComponentMemoryReport& c : components) {
+            if (c.storage) total += c.storage->total_bytes();
+        }
+        return total;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const MemoryReport& report)
+    {
+        const auto kb = [](size_t bytes) { return (double)bytes / 1024.0; };
+
+        const std::ios_base::fmtflags old_flags = os.flags();
+        const std::streamsize old_precision = os.precision();
+        os << std::fixed << std::setprecision(1);
+        os << "ark memory report: " << kb(report.total_bytes()) << " KB total" << std::endl;
+
+        os << "components:" << std::endl;
+        for (const ComponentMemoryReport& c : report.components) {
+            os << "  " << c.component << ": ";
+            if (!c.storage) {
+                os << "(storage doesn't report memory usage)" << std::endl;
+                continue;
+            }
+
+            const StorageMemoryStats& s = *c.storage;
+            os << s.live << "/" << s.capacity << " live, " << kb(s.total_bytes()) << " KB ("
+               << "data " << kb(s.data_bytes) << ", keys " << kb(s.key_bytes) << ", slot ids "
+               << kb(s.slot_id_bytes) << ", other " << kb(s.other_bytes) << ")";
+            if (s.fragmentation_factor) {
+                os << ", fragmentation " << std::setprecision(3) << *s.fragmentation_factor
+                   << std::setprecision(1);
+            }
+            if (s.map) {
+                os << ", map load " << std::setprecision(3) << s.map->load_factor
+                   << std::setprecision(1) << " longest probe " << s.map->longest_probe
+                   << " tombstones " << s.map->tombstones;
+            }
+            os << std::endl;
+        }
+
+        os << "systems:" << std::endl;
+        for (const SystemMemoryReport& s : report.systems) {
+            os << "  " << s.system << ": group " << s.follow_group << ", " << s.followed << "/"
+               << s.capacity << " followed, " << s.pending_changes << " pending, "
+               << kb(s.bytes) << " KB" << std::endl;
+        }
+
+        const WorldMemoryReport& w = report.world;
+        os << "world: " << w.entities << " entities, masks " << kb(w.entity_masks.bytes)
+           << " KB (load " << std::setprecision(3) << w.entity_masks.load_factor
+           << std::setprecision(1) << "), followed sets " << kb(w.followed_set_bytes)
+           << " KB, rosters " << kb(w.roster_bytes) << " KB, queues " << kb(w.queue_bytes)
+           << " KB, frame arenas " << kb(w.frame_arena_bytes) << " KB, delta history "
+           << kb(w.delta_history_bytes) << " KB" << std::endl;
+
+        os.flags(old_flags);
+        os.precision(old_precision);
+        return os;
+    }
+};
+
+} // end namespace ark
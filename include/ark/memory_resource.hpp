@@ -0,0 +1,196 @@
+#pragma once
+
+#include "ark/prelude.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory_resource>
+#include <mutex>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Memory resources for component storages.
+// Bucket arrays and EntityMaps allocate their memory from a std::pmr::memory_resource, by
+// default std::pmr::get_default_resource() (plain operator new). A different resource can
+// be set per storage or for the whole World, see World::set_memory_resource. Storages of
+// different components may allocate concurrently (e.g. in EntityBuilder::spawn_batch_par), so
+// a resource shared between storages must be thread safe. All resources below are.
+
+namespace ark {
+
+// Rounds every allocation up to whole cache lines and aligns it to a cache line, so that no
+// two allocations ever share one. Over-aligned requests keep their larger alignment.
+class CacheAlignedResource : public std::pmr::memory_resource {
+    std::pmr::memory_resource* m_upstream;
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    static inline size_t rounded(size_t bytes)
+    {
+        return (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        return m_upstream->allocate(rounded(bytes), std::max(alignment, CACHE_LINE));
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        m_upstream->deallocate(p, rounded(bytes), std::max(alignment, CACHE_LINE));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+public:
+    explicit CacheAlignedResource(
+        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : m_upstream(upstream)
+    {
+    }
+};
+
+// Backs large allocations (at least half a huge page) with 2MB huge pages, which cuts down
+// TLB misses when iterating storages with many components. Each such allocation is mapped
+// on its own: from the reserved huge page pool (MAP_HUGETLB) if the system has one, and
+// otherwise as 2MB aligned memory flagged for transparent huge pages. Smaller allocations,
+// and all allocations on platforms other than Linux, go to 'upstream'.
+class HugePageResource : public std::pmr::memory_resource {
+    std::pmr::memory_resource* m_upstream;
+
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+private:
+    static inline bool is_huge(size_t bytes) { return bytes >= HUGE_PAGE_SIZE / 2; }
+
+    static inline size_t rounded(size_t bytes)
+    {
+        return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+
+#ifdef __linux__
+    static void* map_huge_pages(size_t size)
+    {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) return memory;
+
+        // Over-map by one huge page, then trim both ends so that what is left is aligned to
+        // a huge page boundary and exactly 'size' bytes long.
+        const size_t padded = size + HUGE_PAGE_SIZE;
+        memory = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+        if (memory == MAP_FAILED) return nullptr;
+
+        const uintptr_t start = (uintptr_t)memory;
+        const uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        if (aligned > start) munmap(memory, aligned - start);
+        const uintptr_t tail = start + padded - (aligned + size);
+        if (tail > 0) munmap((void*)(aligned + size), tail);
+
+        madvise((void*)aligned, size, MADV_HUGEPAGE);
+        return (void*)aligned;
+    }
+#endif
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+#ifdef __linux__
+        if (is_huge(bytes) && alignment <= HUGE_PAGE_SIZE) {
+            // Deallocation tells mapped memory from upstream memory by size alone, so a
+            // failed mapping can't fall back to 'upstream'. ark doesn't use exceptions.
+            void* memory = map_huge_pages(rounded(bytes));
+            if (!memory) std::terminate();
+            return memory;
+        }
+#endif
+        return m_upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+#ifdef __linux__
+        if (is_huge(bytes) && alignment <= HUGE_PAGE_SIZE) {
+            munmap(p, rounded(bytes));
+            return;
+        }
+#endif
+        m_upstream->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+public:
+    explicit HugePageResource(
+        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : m_upstream(upstream)
+    {
+    }
+};
+
+// A monotonic arena: allocation bumps a pointer through large blocks taken from 'upstream',
+// and deallocation does nothing. Memory is only returned when the arena is destroyed, so
+// storages that grow, shrink or get maintained keep all their old memory around in it. It
+// suits Worlds whose size is known up front, with storages reserved before filling them.
+// Unlike std::pmr::monotonic_buffer_resource it is safe to use from several threads.
+class ArenaResource : public std::pmr::memory_resource {
+    std::mutex m_mutex;
+    std::pmr::monotonic_buffer_resource m_arena;
+    size_t m_allocated;
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_allocated += bytes;
+        return m_arena.allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+public:
+    explicit ArenaResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : m_arena(upstream), m_allocated(0)
+    {
+    }
+
+    ArenaResource(const ArenaResource&) = delete;
+    ArenaResource& operator=(const ArenaResource&) = delete;
+
+    // total bytes handed out so far, including those since deallocated
+    size_t allocated(void)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_allocated;
+    }
+};
+
+// Process wide instances of the stateless resources above.
+inline std::pmr::memory_resource* cache_aligned_resource(void)
+{
+    static CacheAlignedResource resource;
+    return &resource;
+}
+
+inline std::pmr::memory_resource* huge_page_resource(void)
+{
+    static HugePageResource resource;
+    return &resource;
+}
+
+} // end namespace ark
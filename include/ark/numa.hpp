@@ -0,0 +1,132 @@
+#pragma once
+
+#include "ark/prelude.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// NUMA placement of component memory.
+// On multi-socket machines memory is local to one node (socket), and reading it from another
+// node costs latency and cross-socket bandwidth. Linux places a page on the node of the
+// thread that first touches it, so ark places component memory by having each ThreadPool
+// worker allocate and first touch the part of a storage it iterates, see
+// World::place_component_memory. This only pays off with workers pinned to CPUs and sticky
+// tasks (see ThreadPoolOptions), so that the same worker iterates the same part every frame.
+
+namespace ark {
+
+inline size_t page_size(void)
+{
+#ifdef __linux__
+    static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+// The memory node each page in 'pages' currently resides on, or -1 where unknown (pages that
+// were never touched, or if the query isn't supported).
+inline void memory_nodes(std::span<const void*> pages, std::span<int> nodes)
+{
+    ARK_ASSERT(pages.size() == nodes.size(), "memory_nodes: mismatched spans");
+    std::fill(nodes.begin(), nodes.end(), -1);
+#ifdef __linux__
+    // move_pages without target nodes only reports where each page is
+    const long result =
+        syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, nodes.data(), 0);
+    if (result != 0) {
+        std::fill(nodes.begin(), nodes.end(), -1);
+    }
+    for (int& node : nodes) {
+        if (node < 0) node = -1; // negative errno for pages that can't be queried
+    }
+#endif
+}
+
+// Pages of a storage's memory by whether they live on the memory node of the worker that
+// iterates them.
+struct NumaLocality {
+    size_t local_pages = 0;
+    size_t remote_pages = 0;
+    size_t unknown_pages = 0; // untouched pages, unpinned workers or no NUMA information
+
+    inline double local_fraction(void) const
+    {
+        const size_t known = local_pages + remote_pages;
+        return known == 0 ? 0.0 : (double)local_pages / (double)known;
+    }
+
+    // Count the pages spanned by 'range', as iterated by a worker on 'worker_node'.
+    void add(std::span<const std::byte> range, int worker_node)
+    {
+        if (range.empty()) return;
+
+        const uintptr_t page = page_size();
+        const uintptr_t first = (uintptr_t)range.data() & ~(page - 1);
+        const uintptr_t end = (uintptr_t)(range.data() + range.size());
+
+        std::vector<const void*> pages;
+        for (uintptr_t address = first; address < end; address += page) {
+            pages.push_back((const void*)address);
+        }
+
+        std::vector<int> nodes(pages.size());
+        memory_nodes(pages, nodes);
+        for (const int node : nodes) {
+            if (node < 0 || worker_node < 0) {
+                unknown_pages++;
+            }
+            else if (node == worker_node) {
+                local_pages++;
+            }
+            else {
+                remote_pages++;
+            }
+        }
+    }
+};
+
+// Locality of each component's memory, returned by World::numa_report.
+struct NumaReport {
+    // empty for storages that don't support NUMA placement
+    std::vector<std::pair<std::string_view, std::optional<NumaLocality>>> components;
+
+    friend std::ostream& operator<<(std::ostream& os, const NumaReport& report)
+    {
+        const std::ios_base::fmtflags old_flags = os.flags();
+        const std::streamsize old_precision = os.precision();
+        os << std::fixed << std::setprecision(1);
+
+        os << "ark numa report:" << std::endl;
+        for (const auto& [component, locality] : report.components) {
+            os << "  " << component << ": ";
+            if (!locality) {
+                os << "(storage doesn't support NUMA placement)" << std::endl;
+                continue;
+            }
+            os << locality->local_pages << " local, " << locality->remote_pages
+               << " remote, " << locality->unknown_pages << " unknown pages ("
+               << 100.0 * locality->local_fraction() << "% local)" << std::endl;
+        }
+
+        os.flags(old_flags);
+        os.precision(old_precision);
+        return os;
+    }
+};
+
+} // end namespace ark
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ark/component.hpp"
+#include "ark/type_list.hpp"
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ark {
+
+// A template for entities with exactly the components 'Ts...', capturing a value for each of
+// them once. Prefabs are instantiated in bulk with EntityBuilder::instantiate or
+// World::instantiate, where every new entity gets a copy of the prefab's components (see
+// ark::detail::attach_copies).
+template <Component... Ts>
+class Prefab {
+    std::tuple<Ts...> m_components;
+
+public:
+    using Components = TypeList<Ts...>;
+
+    Prefab(void) : m_components() {}
+
+    // One argument per component, so that copying a Prefab isn't taken for constructing one
+    // from another.
+    template <typename... Args>
+        requires(sizeof...(Args) == sizeof...(Ts) &&
+                 (std::is_constructible_v<Ts, Args&&> && ...))
+    explicit Prefab(Args&&... components) : m_components(std::forward<Args>(components)...)
+    {
+    }
+
+    template <Component T>
+    inline const T& get(void) const
+    {
+        return std::get<T>(m_components);
+    }
+
+    template <Component T>
+    inline T& get(void)
+    {
+        return std::get<T>(m_components);
+    }
+};
+
+} // end namespace ark
@@ -5,6 +5,7 @@
 #include <atomic>
 #include <cstdint>
 #include <iostream>
+#include <span>
 #include <string_view>
 #include <tuple>
 #include <type_traits>
@@ -31,13 +32,11 @@ namespace ark {
 
 using EntityID = uint32_t;
 
-EntityID next_entity_id(void)
-{
-    static std::atomic<EntityID> next_id = 2;
-    return next_id.fetch_add(1);
-}
+// The first EntityID handed out by each World, 0 and 1 are reserved as sentinels (see
+// EntityMap).
+inline constexpr EntityID FIRST_ENTITY_ID = 2;
 
-std::string entities_to_string(const std::vector<EntityID>& entities)
+std::string entities_to_string(std::span<const EntityID> entities)
 {
     std::stringstream ss;
     for (auto id : entities)
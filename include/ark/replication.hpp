@@ -0,0 +1,140 @@
+#pragma once
+
+#include "ark/prelude.hpp"
+#include "ark/thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Delta replication, see World::collect_delta and World::apply_delta.
+// Components opt into replication with a 'static constexpr bool replicable = true' member.
+// The World then records which entities had such components written (through
+// WriteComponent), attached or detached, and which entities were created or destroyed, each
+// stamped with the World's tick (see World::tick). A delta is built from these records
+// alone, so its size and the time it takes to build depend on how much changed since the
+// requested tick, not on the size of the World.
+//
+// A delta holds, in native byte order and layout like snapshots (see ark/snapshot.hpp):
+// the IDs of destroyed entities, the IDs and replicable component masks of new entities,
+// and for each replicable component the IDs it was detached from, followed by the IDs and
+// values of the components that were attached or changed.
+
+namespace ark {
+
+// clang-format off
+template <typename C>
+concept Replicable = requires
+{
+    requires C::replicable;
+};
+// clang-format on
+
+// IDs of entities whose component was written through WriteComponent, recorded by each
+// thread of a World's ThreadPool into its own list, so that systems can write components
+// from for_each_par without synchronizing. The lists are drained once the systems are done.
+class ChangeLog {
+    struct alignas(64) PerThreadLog {
+        std::vector<EntityID> ids;
+    };
+
+    const ThreadPool* m_pool = nullptr;
+    std::vector<PerThreadLog> m_logs;
+
+public:
+    // One list for each worker of 'pool', and one shared by all other threads (see
+    // ThreadPool::worker_index).
+    void resize(const ThreadPool& pool)
+    {
+        m_pool = &pool;
+        m_logs.resize(pool.nthreads() + 1);
+    }
+
+    inline void record(EntityID id)
+    {
+        ARK_ASSERT(m_pool, "ChangeLog: recorded before being sized for a ThreadPool");
+
+        // writing several members of the same component in a row is the common case
+        std::vector<EntityID>& ids = m_logs[m_pool->worker_index()].ids;
+        if (ids.empty() || ids.back() != id) ids.push_back(id);
+    }
+
+    // Move all recorded IDs to the end of 'out', keeping the lists' memory.
+    void drain(std::vector<EntityID>& out)
+    {
+        for (PerThreadLog& log : m_logs) {
+            out.insert(out.end(), log.ids.begin(), log.ids.end());
+            log.ids.clear();
+        }
+    }
+
+    void clear(void)
+    {
+        for (PerThreadLog& log : m_logs) {
+            log.ids.clear();
+        }
+    }
+
+    size_t memory_usage(void) const
+    {
+        size_t bytes = m_logs.capacity() * sizeof(PerThreadLog);
+        for (const PerThreadLog& log : m_logs) {
+            bytes += log.ids.capacity() * sizeof(EntityID);
+        }
+        return bytes;
+    }
+};
+
+// Entities affected by one kind of change, with the tick of each change, in the order they
+// were recorded (and so in tick order).
+class ChangeHistory {
+    struct Entry {
+        uint64_t tick;
+        EntityID id;
+    };
+
+    std::vector<Entry> m_entries;
+
+    // first entry recorded after 'tick'
+    inline std::vector<Entry>::const_iterator after(uint64_t tick) const
+    {
+        return std::partition_point(m_entries.begin(), m_entries.end(),
+                                    [tick](const Entry& entry) { return entry.tick <= tick; });
+    }
+
+public:
+    inline void record(uint64_t tick, EntityID id) { m_entries.push_back({tick, id}); }
+
+    void record(uint64_t tick, std::span<const EntityID> ids)
+    {
+        m_entries.reserve(m_entries.size() + ids.size());
+        for (const EntityID id : ids) {
+            m_entries.push_back({tick, id});
+        }
+    }
+
+    // Append the IDs of all entities changed after 'tick' to 'out', possibly repeated.
+    void changed_since(uint64_t tick, std::vector<EntityID>& out) const
+    {
+        for (auto it = after(tick); it != m_entries.end(); ++it) {
+            out.push_back(it->id);
+        }
+    }
+
+    // number of changes made after 'tick'
+    inline size_t count_after(uint64_t tick) const
+    {
+        return static_cast<size_t>(m_entries.end() - after(tick));
+    }
+
+    // Drop the changes made up to and including 'tick'.
+    void discard(uint64_t tick) { m_entries.erase(m_entries.begin(), after(tick)); }
+
+    inline void clear(void) { m_entries.clear(); }
+
+    inline size_t memory_usage(void) const { return m_entries.capacity() * sizeof(Entry); }
+};
+
+} // end namespace ark
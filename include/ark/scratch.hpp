@@ -1,36 +1,3 @@
-// template <Component T>
-// float defragment_component_storage(double time_left) {
-//     if constexpr(storage::is_bucket_array<typename T::Storage>::value) {
-//         typename T::Storage* store = m_component_stash.template get<T>();
-//         const std::optional<double> predicted_time = store->estimate_maintenance_time();
-//         if (predicted_time && *predicted_time < time_left) {
-//             const auto start = high_resolution_clock::now();
-//             store->maintenance();
-//             const auto end = high_resolution_clock::now();
-//             const double dur = duration_cast<duration<double>>(end - start).count();
-//             return time_left - dur;
-//         } else {
-//             return time_left;
-//         }
-//     } else {
-//         return time_left;
-//     }
-// }
-
-// void run_maintanence(float allowed_time) {
-//     run_maintanence(allowed_time, AllComponents());
-// }
-
-// template <typename T, typename... Ts>
-// void run_maintanence(float allowed_time, const TypeList<T,Ts...>&) {
-//     allowed_time = defragment_component_storage<T>(allowed_time);
-//     run_maintanence(allowed_time, TypeList<Ts...>());
-// }
-
-// void run_maintanence(float, const TypeList<>&) {
-//     return;
-// }
-
 // ------------------------------------------------------------------------------------
 // Profiling
 
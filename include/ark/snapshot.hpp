@@ -0,0 +1,189 @@
+#pragma once
+
+#include "ark/prelude.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Binary World snapshots, see World::save_snapshot and World::load_snapshot.
+// A snapshot is a header naming each component type and its size, followed by the World's
+// entity bookkeeping and then one section per component storage, in the order of the
+// World's component list. Storages that support it (see detail::save_storage) dump their
+// internal arrays as they are, so that writing and restoring one is mostly bulk copies.
+// Values are stored in the native byte order and layout, so a snapshot can only be loaded by
+// a build of the same World type on the same kind of machine.
+
+namespace ark {
+
+// Writes a snapshot to a file or to a growing byte buffer. Write errors are sticky: once one
+// happens all further writes are ignored, and 'ok' returns false.
+class SnapshotWriter {
+    std::FILE* m_file;
+    std::vector<std::byte>* m_buffer;
+    bool m_ok;
+
+public:
+    explicit SnapshotWriter(std::FILE* file)
+        : m_file(file), m_buffer(nullptr), m_ok(file != nullptr)
+    {
+    }
+
+    explicit SnapshotWriter(std::vector<std::byte>& buffer)
+        : m_file(nullptr), m_buffer(&buffer), m_ok(true)
+    {
+    }
+
+    inline bool ok(void) const { return m_ok; }
+
+    void write_bytes(const void* data, size_t size)
+    {
+        if (!m_ok || size == 0) return;
+        if (m_buffer) {
+            const std::byte* bytes = static_cast<const std::byte*>(data);
+            m_buffer->insert(m_buffer->end(), bytes, bytes + size);
+        }
+        else {
+            m_ok = std::fwrite(data, 1, size, m_file) == size;
+        }
+    }
+
+    template <typename T>
+    inline void write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_bytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    inline void write_array(const T* values, size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_bytes(values, sizeof(T) * count);
+    }
+
+    void write_zeros(size_t size)
+    {
+        static constexpr std::array<std::byte, 4096> zeros = {};
+        while (size > 0) {
+            const size_t chunk = std::min(size, zeros.size());
+            write_bytes(zeros.data(), chunk);
+            size -= chunk;
+        }
+    }
+
+    // Same as write_array, but the values for which 'is_live(i)' is false are written as
+    // zeros. Unused slots of storage arrays hold uninitialized memory or destroyed values,
+    // which must not leak into snapshots or make those of identical Worlds differ.
+    template <typename T, typename IsLive>
+    void write_live_array(const T* values, size_t count, IsLive&& is_live)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        size_t i = 0;
+        while (i < count) {
+            const bool live = is_live(i);
+            const size_t start = i;
+            while (i < count && is_live(i) == live) {
+                i++;
+            }
+            if (live) write_array(values + start, i - start);
+            else write_zeros(sizeof(T) * (i - start));
+        }
+    }
+
+    inline void write_string(std::string_view str)
+    {
+        write<uint32_t>(static_cast<uint32_t>(str.size()));
+        write_bytes(str.data(), str.size());
+    }
+};
+
+// Reads a snapshot back from a file or from memory. Like SnapshotWriter, errors (including
+// running out of data) are sticky, and whatever is read after one is zeroed.
+class SnapshotReader {
+    std::FILE* m_file;
+    std::span<const std::byte> m_buffer;
+    bool m_ok;
+
+public:
+    explicit SnapshotReader(std::FILE* file) : m_file(file), m_buffer(), m_ok(file != nullptr)
+    {
+    }
+
+    explicit SnapshotReader(std::span<const std::byte> buffer)
+        : m_file(nullptr), m_buffer(buffer), m_ok(true)
+    {
+    }
+
+    inline bool ok(void) const { return m_ok; }
+
+    // Flag the snapshot as invalid, for checks beyond running out of data.
+    inline void fail(void) { m_ok = false; }
+
+    // Whether 'size' more bytes can be read, as far as is known without reading them (files
+    // are always assumed to have enough). Lets counts read from the data be checked before
+    // allocating memory for them.
+    inline bool can_read(size_t size) const
+    {
+        return m_ok && (m_file || size <= m_buffer.size());
+    }
+
+    void read_bytes(void* data, size_t size)
+    {
+        // empty arrays may come with a null 'data', which memcpy must not be given
+        if (size == 0) return;
+        if (m_ok) {
+            if (!m_file) {
+                m_ok = size <= m_buffer.size();
+                if (m_ok) {
+                    std::memcpy(data, m_buffer.data(), size);
+                    m_buffer = m_buffer.subspan(size);
+                }
+            }
+            else {
+                m_ok = std::fread(data, 1, size, m_file) == size;
+            }
+        }
+        if (!m_ok) std::memset(data, 0, size);
+    }
+
+    template <typename T>
+    inline T read(void)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        read_bytes(&value, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    inline void read_array(T* values, size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        read_bytes(values, sizeof(T) * count);
+    }
+
+    // Read a string written by SnapshotWriter::write_string and check that it equals 'str'.
+    bool expect_string(std::string_view str)
+    {
+        if (read<uint32_t>() != str.size()) {
+            fail();
+            return false;
+        }
+        std::vector<char> chars(str.size());
+        read_bytes(chars.data(), chars.size());
+        if (!m_ok || std::string_view(chars.data(), chars.size()) != str) {
+            fail();
+        }
+        return m_ok;
+    }
+};
+
+} // end namespace ark
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "ark/prelude.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Data structure statistics.
+// When ARK_ENABLE_STATS is defined, ark's hash maps, component storages and followed entity
+// sets count what happens on their hot paths (probe lengths, rehashes, bucket scans, ...),
+// and ark::World aggregates the counts in 'stats_report()'. Without it, StatCounters is an
+// empty class whose methods do nothing, so the counting compiles away entirely.
+// Counters are relaxed atomics, since e.g. EntityMap lookups happen concurrently from
+// for_each_par, so enabling stats does have a cost in heavily parallel code.
+
+namespace ark {
+
+enum class Stat : size_t {
+    MapLookups,             // EntityMap::lookup calls
+    MapLookupProbes,        // slots probed beyond the first by lookups
+    MapInserts,             // EntityMap::insert calls
+    MapInsertProbes,        // slots probed beyond the first by inserts
+    MapDisplacements,       // entries displaced by robin hood insertion
+    MapRemoves,             // EntityMap::remove calls
+    MapTombstonesProbed,    // tombstones walked over by lookups/removes
+    MapRehashes,            // full rehashes (growing, reserve, shrink)
+    MapIncrementalRehashes, // incremental rehashes started
+    MapSlotsMigrated,       // slots migrated by incremental rehashes
+    BucketScans,            // buckets checked for an open slot by BucketArray inserts
+    MaintenanceRuns,        // BucketArrayStorage::maintenance calls
+    MaintenanceSwaps,       // components swapped between slots by maintenance
+    MaintenanceMoves,       // components moved into empty slots by maintenance
+    SetConsolidations,      // FlatEntitySet::consolidate calls with pending changes
+    SetSortsSkipped,        // ...of which had already sorted pending changes
+    SetEagerConsolidations, // ...of which were forced by too many pending changes
+    SetChangesApplied,      // pending insertions/removals consolidated
+    PageCopies,             // shared PagedStorage pages copied on first write
+    COUNT
+};
+
+inline constexpr size_t NUM_STATS = static_cast<size_t>(Stat::COUNT);
+
+inline constexpr std::array<std::string_view, NUM_STATS> STAT_NAMES = {
+    "map lookups",
+    "map lookup probes",
+    "map inserts",
+    "map insert probes",
+    "map displacements",
+    "map removes",
+    "map tombstones probed",
+    "map rehashes",
+    "map incremental rehashes",
+    "map slots migrated",
+    "bucket scans",
+    "maintenance runs",
+    "maintenance swaps",
+    "maintenance moves",
+    "set consolidations",
+    "set sorts skipped",
+    "set eager consolidations",
+    "set changes applied",
+    "page copies",
+};
+
+// A plain copy of a set of counters at some point in time.
+struct StatsSnapshot {
+    std::array<uint64_t, NUM_STATS> values = {};
+
+    inline uint64_t operator[](Stat stat) const { return values[static_cast<size_t>(stat)]; }
+
+    StatsSnapshot& operator+=(const StatsSnapshot& other)
+    {
+        for (size_t i = 0; i < NUM_STATS; i++) {
+            values[i] += other.values[i];
+        }
+        return *this;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const StatsSnapshot& snapshot)
+    {
+        bool first = true;
+        for (size_t i = 0; i < NUM_STATS; i++) {
+            if (snapshot.values[i] == 0) continue;
+            os << (first ? "" : ", ") << STAT_NAMES[i] << " " << snapshot.values[i];
+            first = false;
+        }
+        if (first) os << "-";
+        return os;
+    }
+};
+
+#ifdef ARK_ENABLE_STATS
+
+class StatCounters {
+    mutable std::array<std::atomic<uint64_t>, NUM_STATS> m_counts = {};
+
+public:
+    inline void add(Stat stat, uint64_t count = 1) const
+    {
+        m_counts[static_cast<size_t>(stat)].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    StatsSnapshot snapshot(void) const
+    {
+        StatsSnapshot result;
+        for (size_t i = 0; i < NUM_STATS; i++) {
+            result.values[i] = m_counts[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    void reset(void)
+    {
+        for (std::atomic<uint64_t>& count : m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+#else
+
+class StatCounters {
+public:
+    inline void add(Stat, uint64_t = 1) const {}
+    inline StatsSnapshot snapshot(void) const { return StatsSnapshot(); }
+    inline void reset(void) {}
+};
+
+#endif
+
+// Counters aggregated over an entire ark::World, see World::stats_report.
+struct StatsReport {
+    std::vector<std::pair<std::string_view, StatsSnapshot>> components;
+    StatsSnapshot entity_masks;
+    StatsSnapshot followed_sets;
+
+    StatsSnapshot total(void) const
+    {
+        StatsSnapshot result = entity_masks;
+        result += followed_sets;
+        for (const auto& [component, snapshot] : components) {
+            result += snapshot;
+        }
+        return result;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const StatsReport& report)
+    {
+        os << "ark stats:" << std::endl;
+        for (const auto& [component, snapshot] : report.components) {
+            os << "  " << component << ": " << snapshot << std::endl;
+        }
+        os << "  entity masks: " << report.entity_masks << std::endl;
+        os << "  followed sets: " << report.followed_sets << std::endl;
+        return os;
+    }
+};
+
+} // end namespace ark
@@ -1,19 +1,27 @@
 #pragma once
 
 #include "ark/flat_hash_map.hpp"
+#include "ark/memory_report.hpp"
+#include "ark/numa.hpp"
 #include "ark/prelude.hpp"
+#include "ark/snapshot.hpp"
+#include "ark/stats.hpp"
 #include "ark/third_party/skarupke/ska_sort.hpp"
 
 #include <array>
 #include <assert.h>
 #include <chrono>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <math.h>
 #include <memory>
+#include <memory_resource>
 #include <new>
 #include <optional>
+#include <span>
 #include <type_traits>
 #include <vector>
 
@@ -48,11 +56,50 @@ class Bucket {
     size_t m_num_active_slots;
     uint16_t m_next_open_slot;
 
+    // 1 + the worker part this bucket's memory was last placed for, 0 if never placed
+    uint16_t m_placement;
+
+    // where m_data and m_slot_ids were allocated from, and their alignment (their sizes are
+    // rounded up to a multiple of it)
+    std::pmr::memory_resource* m_resource;
+    size_t m_alignment;
+
+    // malloc's alignment, or that of T if it is over-aligned
+    static constexpr size_t DEFAULT_ALIGNMENT =
+        std::max(alignof(T), alignof(std::max_align_t));
+
+    static inline size_t allocation_size(size_t bytes, size_t alignment)
+    {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    // With 'touch', the memory is zeroed by the calling thread so that all of it is first
+    // touched there.
+    static void* allocate(std::pmr::memory_resource* resource, size_t bytes, size_t alignment,
+                          bool touch)
+    {
+        const size_t size = allocation_size(bytes, alignment);
+        void* memory = resource->allocate(size, alignment);
+        ARK_ASSERT(memory, "Bucket: failed to allocate " << size << " bytes");
+        if (touch) std::memset(memory, 0, size);
+        return memory;
+    }
+
+    void deallocate(void)
+    {
+        m_resource->deallocate(m_data, allocation_size(sizeof(T) * N, m_alignment),
+                               m_alignment);
+        m_resource->deallocate(m_slot_ids, allocation_size(sizeof(EntityID) * N, m_alignment),
+                               m_alignment);
+    }
+
 public:
-    Bucket(void)
-        : m_data((T*)malloc(sizeof(T) * N)),
-          m_slot_ids((EntityID*)malloc(sizeof(EntityID) * N)), m_num_active_slots(0),
-          m_next_open_slot(0)
+    explicit Bucket(std::pmr::memory_resource* resource)
+        : m_data((T*)allocate(resource, sizeof(T) * N, DEFAULT_ALIGNMENT, false)),
+          m_slot_ids((EntityID*)allocate(resource, sizeof(EntityID) * N, DEFAULT_ALIGNMENT,
+                                         false)),
+          m_num_active_slots(0), m_next_open_slot(0), m_placement(0), m_resource(resource),
+          m_alignment(DEFAULT_ALIGNMENT)
     {
         for (size_t i = 0; i < N; i++) {
             m_slot_ids[i] = NO_ENTITY;
@@ -75,8 +122,7 @@ public:
             }
         }
 
-        free(m_data);
-        free(m_slot_ids);
+        deallocate();
         m_num_active_slots = 0;
         m_next_open_slot = NO_OPEN_SLOT;
     }
@@ -107,8 +153,95 @@ public:
 
     inline bool is_full(void) const { return m_num_active_slots == N; }
 
+    inline std::span<const std::byte> data_bytes(void) const
+    {
+        return std::span<const std::byte>((const std::byte*)m_data, sizeof(T) * N);
+    }
+
+    inline std::pmr::memory_resource* memory_resource(void) const { return m_resource; }
+
+    // Move the bucket's contents into new memory from 'resource'. With 'touch', that memory
+    // is page aligned and first touched by the calling thread, so that it ends up on the
+    // calling thread's memory node. Either way, the bucket counts as not placed afterwards.
+    void relocate(std::pmr::memory_resource* resource, bool touch)
+    {
+        const size_t alignment = touch ? std::max(DEFAULT_ALIGNMENT, page_size())
+                                       : DEFAULT_ALIGNMENT;
+        T* data = (T*)allocate(resource, sizeof(T) * N, alignment, touch);
+        EntityID* slot_ids = (EntityID*)allocate(resource, sizeof(EntityID) * N, alignment,
+                                                 touch);
+
+        for (size_t i = 0; i < N; i++) {
+            slot_ids[i] = m_slot_ids[i];
+            if (m_slot_ids[i] != NO_ENTITY) {
+                new (&data[i]) T(std::move(m_data[i]));
+                m_data[i].~T();
+            }
+        }
+
+        deallocate();
+        m_data = data;
+        m_slot_ids = slot_ids;
+        m_resource = resource;
+        m_alignment = alignment;
+        m_placement = 0;
+    }
+
     inline size_t num_active_slots(void) const { return m_num_active_slots; }
 
+    // Make this bucket a copy of 'other', in place.
+    void copy_from(const Bucket& other)
+    {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            std::memcpy(m_slot_ids, other.m_slot_ids, sizeof(EntityID) * N);
+            std::memcpy((void*)m_data, (const void*)other.m_data, sizeof(T) * N);
+        }
+        else {
+            for (size_t i = 0; i < N; i++) {
+                if (m_slot_ids[i] != NO_ENTITY) m_data[i].~T();
+                m_slot_ids[i] = other.m_slot_ids[i];
+                if (m_slot_ids[i] != NO_ENTITY) new (&m_data[i]) T(other.m_data[i]);
+            }
+        }
+        m_num_active_slots = other.m_num_active_slots;
+        m_next_open_slot = other.m_next_open_slot;
+    }
+
+    // Dump the slot ids and the whole data array, with empty slots zeroed, see
+    // ark/snapshot.hpp.
+    void save(SnapshotWriter& out) const
+    {
+        out.write_array(m_slot_ids, N);
+        out.write_live_array(m_data, N,
+                             [this](size_t i) { return m_slot_ids[i] != NO_ENTITY; });
+    }
+
+    // Replace the contents of an empty bucket with those saved by 'save'. On failure the
+    // bucket is left empty.
+    bool load(SnapshotReader& in)
+    {
+        assert(m_num_active_slots == 0 && "Attempted to load into a non-empty Bucket.");
+
+        in.read_array(m_slot_ids, N);
+        in.read_array(m_data, N);
+        if (!in.ok()) {
+            for (size_t i = 0; i < N; i++) {
+                m_slot_ids[i] = NO_ENTITY;
+            }
+        }
+
+        m_next_open_slot = NO_OPEN_SLOT;
+        for (size_t i = N; i-- > 0;) {
+            if (m_slot_ids[i] != NO_ENTITY) {
+                m_num_active_slots++;
+            }
+            else {
+                m_next_open_slot = static_cast<uint16_t>(i);
+            }
+        }
+        return in.ok();
+    }
+
     template <typename... Args>
     uint16_t insert(EntityID id, Args&&... args)
     {
@@ -129,6 +262,36 @@ public:
         return new_slot;
     }
 
+    // Copy 'value' into open slots for as many of 'ids' as fit, writing the slot given to
+    // each to 'slots', and return how many were inserted. Runs of consecutive open slots are
+    // filled at once, which for trivially copyable components is a plain fill.
+    size_t insert_copies(std::span<const EntityID> ids, const T& value, uint16_t* slots)
+    {
+        size_t inserted = 0;
+        size_t slot = m_next_open_slot == NO_OPEN_SLOT ? N : m_next_open_slot;
+        while (slot < N && inserted < ids.size()) {
+            size_t run_end = slot;
+            while (run_end < N && run_end - slot < ids.size() - inserted &&
+                   m_slot_ids[run_end] == NO_ENTITY) {
+                run_end++;
+            }
+
+            std::uninitialized_fill(m_data + slot, m_data + run_end, value);
+            for (; slot < run_end; slot++) {
+                m_slot_ids[slot] = ids[inserted];
+                slots[inserted++] = static_cast<uint16_t>(slot);
+            }
+
+            while (slot < N && m_slot_ids[slot] != NO_ENTITY) {
+                slot++;
+            }
+        }
+
+        m_num_active_slots += inserted;
+        m_next_open_slot = slot < N ? static_cast<uint16_t>(slot) : NO_OPEN_SLOT;
+        return inserted;
+    }
+
     void release_slot(size_t slot_index)
     {
         assert(m_num_active_slots > 0 && "Attempted to release slot from empty Bucket.");
@@ -154,7 +317,13 @@ class BucketArray {
 
     std::vector<std::unique_ptr<Bucket<T, N>>> m_buckets;
 
-    inline void create_new_bucket(void) { m_buckets.emplace_back(new Bucket<T, N>()); }
+    // new buckets allocate their memory from here
+    std::pmr::memory_resource* m_resource;
+
+    inline void create_new_bucket(void)
+    {
+        m_buckets.emplace_back(new Bucket<T, N>(m_resource));
+    }
 
 public:
     struct Key {
@@ -184,13 +353,71 @@ public:
         }
     };
 
-    BucketArray(void)
+    explicit BucketArray(
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_resource(resource)
     {
         m_buckets.reserve(16);
         create_new_bucket();
     }
 
+    inline std::pmr::memory_resource* memory_resource(void) const { return m_resource; }
+
+    // Allocate buckets from 'resource' from now on, moving all existing buckets over to it.
+    void set_memory_resource(std::pmr::memory_resource* resource)
+    {
+        m_resource = resource;
+        for (auto& bucket : m_buckets) {
+            if (bucket->memory_resource() != resource) {
+                bucket->relocate(resource, false);
+            }
+        }
+    }
+
+    // Create enough buckets up front to hold 'count' items in total.
+    void reserve(size_t count)
+    {
+        const size_t num_buckets = (count + N - 1) / N;
+        ARK_ASSERT(num_buckets <= 65535, "BucketArray: can't reserve " << count << " slots.");
+
+        m_buckets.reserve(num_buckets);
+        while (m_buckets.size() < num_buckets) {
+            create_new_bucket();
+        }
+    }
+
+    // Make this array a copy of 'other', reusing the buckets it already has.
+    void copy_from(const BucketArray& other)
+    {
+        m_buckets.resize(std::min(m_buckets.size(), other.m_buckets.size()));
+        while (m_buckets.size() < other.m_buckets.size()) {
+            create_new_bucket();
+        }
+        for (size_t i = 0; i < m_buckets.size(); i++) {
+            m_buckets[i]->copy_from(*other.m_buckets[i]);
+        }
+    }
+
+    // Destroy all buckets and start over with 'num_buckets' empty ones (at least one).
+    void reset(size_t num_buckets)
+    {
+        m_buckets.clear();
+        m_buckets.reserve(std::max(num_buckets, size_t(16)));
+        do {
+            create_new_bucket();
+        } while (m_buckets.size() < num_buckets);
+    }
+
+    // Free empty buckets at the end of the array, always keeping at least one bucket.
+    void release_empty_buckets(void)
+    {
+        while (m_buckets.size() > 1 && m_buckets.back()->num_active_slots() == 0) {
+            m_buckets.pop_back();
+        }
+    }
+
     Bucket<T, N>* get_ith_bucket(size_t i) { return m_buckets[i].get(); }
+    const Bucket<T, N>* get_ith_bucket(size_t i) const { return m_buckets[i].get(); }
     size_t num_buckets(void) const { return m_buckets.size(); }
 
     void set_entity_at_key(EntityID id, const Key& key)
@@ -211,9 +438,20 @@ public:
     template <typename... Args>
     const Key insert(Args&&... args)
     {
-        for (uint16_t bucket_id = 0; bucket_id < m_buckets.size(); bucket_id++) {
+        uint16_t first_bucket = 0;
+        return insert_from(first_bucket, std::forward<Args>(args)...);
+    }
+
+    // Same as insert, but only looks for an open slot starting at bucket 'first_bucket', which
+    // is then updated to the bucket the item was inserted into. When inserting many items in
+    // a row, this avoids re-scanning the buckets that were already found to be full.
+    template <typename... Args>
+    const Key insert_from(uint16_t& first_bucket, Args&&... args)
+    {
+        for (uint16_t bucket_id = first_bucket; bucket_id < m_buckets.size(); bucket_id++) {
             auto& bucket = m_buckets[bucket_id];
             if (!bucket->is_full()) {
+                first_bucket = bucket_id;
                 return Key{.bucket = bucket_id,
                            .slot = bucket->insert(std::forward<Args>(args)...)};
             }
@@ -223,12 +461,36 @@ public:
         // make a new one.
         const uint16_t new_bucket_idx = m_buckets.size();
         create_new_bucket();
+        first_bucket = new_bucket_idx;
 
         return Key{.bucket = new_bucket_idx,
                    // static_cast<uint16_t>(m_buckets.size()) - static_cast<uint16_t>(1),
                    .slot = m_buckets.back()->insert(std::forward<Args>(args)...)};
     }
 
+    // Copy 'value' into an open slot for each of 'ids', looking for open slots starting at
+    // bucket 'first_bucket' as insert_from does, and call 'f(id, key)' for each of them.
+    template <typename Callable>
+    void insert_copies_from(uint16_t& first_bucket, std::span<const EntityID> ids,
+                            const T& value, Callable&& f)
+    {
+        std::array<uint16_t, N> slots;
+        size_t done = 0;
+        for (uint16_t bucket_id = first_bucket; done < ids.size(); bucket_id++) {
+            if (bucket_id == m_buckets.size()) create_new_bucket();
+            Bucket<T, N>& bucket = *m_buckets[bucket_id];
+            if (bucket.is_full()) continue;
+
+            first_bucket = bucket_id;
+            const size_t inserted =
+                bucket.insert_copies(ids.subspan(done), value, slots.data());
+            for (size_t i = 0; i < inserted; i++) {
+                f(ids[done + i], Key{.bucket = bucket_id, .slot = slots[i]});
+            }
+            done += inserted;
+        }
+    }
+
     inline void remove(const Key key) { m_buckets[key.bucket]->release_slot(key.slot); }
 
     inline T& operator[](const Key key)
@@ -267,6 +529,11 @@ class BucketArrayStorage {
 
     size_t m_removals_since_defrag;
 
+    [[no_unique_address]] StatCounters m_stats;
+
+    // maintenance shrinks the key map when it is less than this full
+    static constexpr double MIN_KEYS_LOAD_FACTOR = 0.125;
+
 public:
     using ComponentType = T;
 
@@ -289,6 +556,7 @@ public:
 
     void maintenance(void)
     {
+        m_stats.add(Stat::MaintenanceRuns);
         m_removals_since_defrag = 0;
         const size_t num_buckets = m_array.num_buckets();
         const size_t total_slots = num_buckets * N;
@@ -326,7 +594,7 @@ public:
                 // @OPTIMIZE: I left some unecessarily slow code in here (double map
                 // lookups) to make sure it is correct.
                 if (old_entity_at_slot != new_entity_at_slot) {
-                    const Key focus_key = Key{ibucket, islot};
+                    const Key focus_key = Key{static_cast<uint16_t>(ibucket), static_cast<uint16_t>(islot)};
                     const Key new_entities_current_key = m_keys[new_entity_at_slot];
                     const bool already_swapped = focus_key == new_entities_current_key;
                     // if (already_swapped) {
@@ -345,6 +613,7 @@ public:
                                        "inconsistency in bucket_array maintenance keys"
                                            << old_entities_current_key << " " << focus_key);
 
+                            m_stats.add(Stat::MaintenanceSwaps);
                             m_keys[new_entity_at_slot] = focus_key;
                             m_keys[old_entity_at_slot] = new_entities_current_key;
                             std::swap(m_array.data_at(new_entities_current_key),
@@ -354,9 +623,13 @@ public:
                                                       new_entities_current_key);
                         }
                         else {
+                            m_stats.add(Stat::MaintenanceMoves);
                             m_keys[new_entity_at_slot] = focus_key;
-                            m_array.data_at(focus_key) =
-                                std::move(m_array.data_at(new_entities_current_key));
+                            // the slot at focus_key is empty, so there is no object there
+                            // to assign to, and the moved-from one has to be destroyed
+                            T& moved_from = m_array.data_at(new_entities_current_key);
+                            new (&m_array.data_at(focus_key)) T(std::move(moved_from));
+                            moved_from.~T();
                             m_array.set_entity_at_key(new_entity_at_slot, focus_key);
                             m_array.set_entity_at_key(NO_ENTITY, new_entities_current_key);
                         }
@@ -364,6 +637,26 @@ public:
                 }
             }
         }
+
+        // Sorting packed all components into the first buckets, so any memory held on to
+        // after a large number of removals can now be released.
+        m_array.release_empty_buckets();
+        if (m_keys.load_factor() < MIN_KEYS_LOAD_FACTOR) {
+            m_keys.shrink_to_fit();
+        }
+        if (m_sort_buffer.capacity() > m_array.num_buckets() * N) {
+            m_sort_buffer.clear();
+            m_sort_buffer.shrink_to_fit();
+        }
+    }
+
+    // Compact the storage as much as possible and release all memory not currently needed.
+    void shrink_to_fit(void)
+    {
+        maintenance();
+        m_keys.shrink_to_fit();
+        m_sort_buffer.clear();
+        m_sort_buffer.shrink_to_fit();
     }
 
     inline T& get(EntityID id)
@@ -401,14 +694,199 @@ public:
         assert(!has(id) && "Attempted to attach component to entity that already "
                            "posesses that component.");
         ARK_LOG_EVERYTHING("attaching " << detail::type_name<T>() << " to entity: " << id);
-        const Key new_key = m_array.insert(id, std::forward<Args>(args)...);
-        auto x = m_keys.insert(id, new_key);
+        uint16_t first_bucket = 0;
+        const Key new_key = m_array.insert_from(first_bucket, id, std::forward<Args>(args)...);
+        m_stats.add(Stat::BucketScans, new_key.bucket + 1);
+        [[maybe_unused]] auto x = m_keys.insert(id, new_key);
         ARK_ASSERT(m_keys.lookup(id), "Failed to insert key into map after attaching "
                                           << detail::type_name<T>() << " to entity: " << id
                                           << " " << x);
         return m_array[new_key];
     }
 
+    void reserve(size_t count)
+    {
+        m_array.reserve(count);
+        m_keys.reserve(count);
+    }
+
+    inline void set_incremental_rehash(bool enabled) { m_keys.set_incremental_rehash(enabled); }
+
+    // Allocate both the buckets and the key map from 'resource', see ark/memory_resource.hpp.
+    void set_memory_resource(std::pmr::memory_resource* resource)
+    {
+        m_array.set_memory_resource(resource);
+        m_keys.set_memory_resource(resource);
+    }
+
+    StorageMemoryStats memory_stats(void) const
+    {
+        const size_t slots = m_array.num_buckets() * N;
+
+        StorageMemoryStats stats;
+        stats.map = m_keys.stats();
+        stats.live = m_keys.size();
+        stats.capacity = slots;
+        stats.data_bytes = slots * sizeof(T);
+        stats.key_bytes = stats.map->bytes;
+        stats.slot_id_bytes = slots * sizeof(EntityID);
+        stats.other_bytes = m_sort_buffer.capacity() * sizeof(EntityID);
+        stats.fragmentation_factor = fragmentation_factor();
+        return stats;
+    }
+
+    // NUMA placement, see ark/numa.hpp. The buckets are split into 'nparts' contiguous
+    // ranges, one per ThreadPool worker. After maintenance components are sorted by EntityID,
+    // so these line up roughly with the chunks for_each_par hands to each worker.
+    // Relocate the buckets of 'part' that weren't placed for it yet, from the worker that
+    // iterates that part.
+    void place_for_worker(size_t part, size_t nparts)
+    {
+        const size_t num_buckets = m_array.num_buckets();
+        const size_t begin = part * num_buckets / nparts;
+        const size_t end = (part + 1) * num_buckets / nparts;
+        for (size_t i = begin; i < end; i++) {
+            storage::Bucket<T, N>* bucket = m_array.get_ith_bucket(i);
+            if (bucket->m_placement != part + 1) {
+                bucket->relocate(bucket->memory_resource(), true);
+                bucket->m_placement = static_cast<uint16_t>(part + 1);
+            }
+        }
+    }
+
+    // the component memory of 'part' of the buckets, split as in 'place_for_worker'
+    void memory_ranges(size_t part, size_t nparts,
+                       std::vector<std::span<const std::byte>>& ranges) const
+    {
+        const size_t num_buckets = m_array.num_buckets();
+        const size_t begin = part * num_buckets / nparts;
+        const size_t end = (part + 1) * num_buckets / nparts;
+        for (size_t i = begin; i < end; i++) {
+            ranges.push_back(m_array.get_ith_bucket(i)->data_bytes());
+        }
+    }
+
+    // Make this storage a copy of 'other', see World::clone_into. Bucket and table memory
+    // this storage already has is reused, and for trivially copyable components everything
+    // is copied with memcpy.
+    void copy_from(const BucketArrayStorage& other)
+    {
+        m_array.copy_from(other.m_array);
+        m_keys.copy_from(other.m_keys);
+        m_removals_since_defrag = other.m_removals_since_defrag;
+    }
+
+    // Call 'f(std::span<const EntityID>, std::span<const T>)' for each run of consecutive
+    // filled slots of each bucket, straight from the bucket's memory. See
+    // World::for_each_column_chunk. Right after maintenance every bucket is a single run.
+    template <typename Callable>
+    void for_each_chunk(Callable&& f) const
+    {
+        for (size_t i = 0; i < m_array.num_buckets(); i++) {
+            const storage::Bucket<T, N>* bucket = m_array.get_ith_bucket(i);
+            size_t slot = 0;
+            while (slot < N) {
+                if (bucket->m_slot_ids[slot] == NO_ENTITY) {
+                    slot++;
+                    continue;
+                }
+                const size_t start = slot;
+                while (slot < N && bucket->m_slot_ids[slot] != NO_ENTITY) {
+                    slot++;
+                }
+                f(std::span<const EntityID>(bucket->m_slot_ids + start, slot - start),
+                  std::span<const T>(bucket->m_data + start, slot - start));
+            }
+        }
+    }
+
+    // Snapshots, see ark/snapshot.hpp. Buckets and the key map are dumped as they are, so
+    // restoring a storage is a few bulk reads.
+    void save(SnapshotWriter& out) const
+    {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "BucketArrayStorage: only trivially copyable components can be saved");
+
+        out.write<uint64_t>(N);
+        out.write<uint64_t>(sizeof(T));
+        out.write<uint64_t>(m_removals_since_defrag);
+        out.write<uint64_t>(m_array.num_buckets());
+        for (size_t i = 0; i < m_array.num_buckets(); i++) {
+            m_array.get_ith_bucket(i)->save(out);
+        }
+        m_keys.save(out);
+    }
+
+    // Replace the contents of the storage with those saved by 'save'. On failure the storage
+    // is left empty.
+    bool load(SnapshotReader& in)
+    {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "BucketArrayStorage: only trivially copyable components can be loaded");
+
+        const uint64_t bucket_size = in.read<uint64_t>();
+        const uint64_t component_size = in.read<uint64_t>();
+        m_removals_since_defrag = in.read<uint64_t>();
+        const size_t num_buckets = in.read<uint64_t>();
+        if (bucket_size != N || component_size != sizeof(T) || num_buckets > 65535) in.fail();
+
+        m_array.reset(in.ok() ? num_buckets : 1);
+        for (size_t i = 0; i < m_array.num_buckets() && in.ok(); i++) {
+            m_array.get_ith_bucket(i)->load(in);
+        }
+        m_keys.load(in);
+
+        if (!in.ok()) {
+            m_array.reset(1);
+            m_keys.clear();
+            m_removals_since_defrag = 0;
+        }
+        return in.ok();
+    }
+
+    // Hot path counters of this storage and its key map, see ark/stats.hpp.
+    StatsSnapshot counters(void) const
+    {
+        StatsSnapshot result = m_stats.snapshot();
+        result += m_keys.counters();
+        return result;
+    }
+
+    void reset_counters(void)
+    {
+        m_stats.reset();
+        m_keys.reset_counters();
+    }
+
+    // Bulk attach, see ark::detail::attach_all.
+    template <typename Generator>
+    void attach_all(std::span<const EntityID> ids, Generator&& generator)
+    {
+        m_keys.reserve(m_keys.size() + ids.size());
+
+        uint16_t first_bucket = 0;
+        for (const EntityID id : ids) {
+            assert(!has(id) && "Attempted to attach component to entity that already "
+                               "posesses that component.");
+            const uint16_t scan_start = first_bucket;
+            m_keys.insert(id, m_array.insert_from(first_bucket, id, generator(id)));
+            m_stats.add(Stat::BucketScans, first_bucket - scan_start + 1);
+        }
+    }
+
+    // Bulk attach of copies of a single component, see ark::detail::attach_copies.
+    void attach_copies(std::span<const EntityID> ids, const T& value)
+    {
+        m_keys.reserve(m_keys.size() + ids.size());
+
+        uint16_t first_bucket = 0;
+        m_array.insert_copies_from(first_bucket, ids, value, [this](EntityID id, Key key) {
+            assert(!has(id) && "Attempted to attach component to entity that already "
+                               "posesses that component.");
+            m_keys.insert(id, key);
+        });
+    }
+
     inline void detach(EntityID id)
     {
         const Key old_key = m_keys[id];
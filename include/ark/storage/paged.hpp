@@ -0,0 +1,353 @@
+#pragma once
+
+#include "ark/memory_report.hpp"
+#include "ark/prelude.hpp"
+#include "ark/stats.hpp"
+
+#include <algorithm>
+#include <array>
+#include <assert.h>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <utility>
+
+namespace ark {
+
+// A sparse array of components indexed directly by EntityID, split into pages of N
+// components each. Pages are reference counted and shared copy-on-write between copies of
+// the storage: copying one (see World::clone_into and World::fork) only copies the page
+// table, and a page is copied the first time either copy writes to it, through
+// WriteComponent, attach, or detach. ReadComponent never copies. Forked Worlds (speculative
+// simulation, AI lookahead, rollback checkpoints) so only pay for the pages they modify.
+//
+// Since EntityIDs are handed out in increasing order and never reused, the page table
+// grows with the largest EntityID that ever had the component, one pointer per N IDs.
+// Pages are freed once all components in them are detached.
+template <typename T, size_t N = 256>
+class PagedStorage {
+    static_assert(N > 0 && N % 64 == 0, "PagedStorage: page size must be a multiple of 64.");
+
+    struct Page {
+        std::atomic<uint32_t> refs;
+        uint32_t count;
+        std::array<uint64_t, N / 64> occupied;
+        alignas(T) std::byte data[sizeof(T) * N];
+
+        Page(void) : refs(1), count(0), occupied() {}
+
+        Page(const Page& other) : refs(1), count(other.count), occupied(other.occupied)
+        {
+            for_each_slot([&](size_t slot) { new (at(slot)) T(*other.at(slot)); });
+        }
+
+        Page& operator=(const Page&) = delete;
+
+        ~Page(void)
+        {
+            for_each_slot([&](size_t slot) { at(slot)->~T(); });
+        }
+
+        inline bool has(size_t slot) const { return occupied[slot / 64] >> (slot % 64) & 1; }
+        inline void set(size_t slot) { occupied[slot / 64] |= uint64_t(1) << (slot % 64); }
+        inline void unset(size_t slot)
+        {
+            occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+        }
+
+        inline T* at(size_t slot) { return std::launder(reinterpret_cast<T*>(data) + slot); }
+
+        inline const T* at(size_t slot) const
+        {
+            return std::launder(reinterpret_cast<const T*>(data) + slot);
+        }
+
+        template <typename Callable>
+        void for_each_slot(Callable&& f) const
+        {
+            for (size_t word = 0; word < N / 64; word++) {
+                for (uint64_t bits = occupied[word]; bits != 0; bits &= bits - 1) {
+                    f(word * 64 + (size_t)std::countr_zero(bits));
+                }
+            }
+        }
+    };
+
+    // 'owned' is set once this storage is known to hold the only reference to 'page'. Only
+    // other storages sharing a page can release it concurrently with this one's writers, so
+    // an owned page stays valid and unshared until this storage itself replaces it.
+    struct Entry {
+        std::atomic<Page*> page;
+        std::atomic<bool> owned;
+    };
+
+    // Entries are only replaced concurrently with other accesses when a shared page is
+    // copied, which happens under m_copy_mutex. The table itself only grows in attach.
+    std::unique_ptr<Entry[]> m_pages;
+    size_t m_num_pages;
+    size_t m_size;
+
+    std::mutex m_copy_mutex;
+
+    [[no_unique_address]] StatCounters m_stats;
+
+    static inline void release(Page* page)
+    {
+        if (page && page->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete page;
+        }
+    }
+
+    inline Page* page_at(size_t index) const
+    {
+        return index < m_num_pages ? m_pages[index].page.load(std::memory_order_acquire)
+                                   : nullptr;
+    }
+
+    // The page at 'index', copied first if it is shared with another storage. Several
+    // threads may ask for the same shared page at once from for_each_par, so copying is
+    // serialized and re-checked under the lock.
+    //
+    // Only pages this storage owns are used without the lock. A page that isn't owned may be
+    // released at any time, by the other storages sharing it and by this storage's thread
+    // copying it, so its reference count can't even be read safely outside the lock.
+    Page* writable_page(size_t index)
+    {
+        if (index >= m_num_pages) return nullptr;
+        Entry& entry = m_pages[index];
+        if (entry.owned.load(std::memory_order_acquire)) {
+            return entry.page.load(std::memory_order_relaxed);
+        }
+
+        std::lock_guard<std::mutex> lock(m_copy_mutex);
+        Page* page = entry.page.load(std::memory_order_acquire);
+        if (!page) return nullptr;
+
+        if (page->refs.load(std::memory_order_acquire) > 1) {
+            m_stats.add(Stat::PageCopies);
+            Page* copy = new Page(*page);
+            entry.page.store(copy, std::memory_order_release);
+            release(page);
+            page = copy;
+        }
+        entry.owned.store(true, std::memory_order_release);
+        return page;
+    }
+
+    // Make 'entry' point to 'page', owned by this storage or shared with others.
+    static inline void set_entry(Entry& entry, Page* page, bool owned)
+    {
+        entry.page.store(page, std::memory_order_release);
+        entry.owned.store(owned, std::memory_order_release);
+    }
+
+    // Move the page table into a new one of 'size' entries.
+    void resize_page_table(size_t size)
+    {
+        std::unique_ptr<Entry[]> pages(size > 0 ? new Entry[size] : nullptr);
+        for (size_t i = 0; i < size; i++) {
+            if (i < m_num_pages) {
+                const bool owned = m_pages[i].owned.load(std::memory_order_relaxed);
+                set_entry(pages[i], page_at(i), owned);
+            }
+            else {
+                set_entry(pages[i], nullptr, false);
+            }
+        }
+        m_pages = std::move(pages);
+        m_num_pages = size;
+    }
+
+    void grow_page_table(size_t num_pages)
+    {
+        if (num_pages <= m_num_pages) return;
+
+        resize_page_table(std::max(num_pages, 2 * m_num_pages));
+    }
+
+    void release_all(void)
+    {
+        for (size_t i = 0; i < m_num_pages; i++) {
+            m_pages[i].owned.store(false, std::memory_order_relaxed);
+            release(m_pages[i].page.exchange(nullptr, std::memory_order_acq_rel));
+        }
+        m_size = 0;
+    }
+
+public:
+    using ComponentType = T;
+
+    PagedStorage(void) : m_pages(), m_num_pages(0), m_size(0) {}
+
+    PagedStorage(const PagedStorage&) = delete;
+    PagedStorage& operator=(const PagedStorage&) = delete;
+
+    ~PagedStorage(void) { release_all(); }
+
+    inline size_t size(void) const { return m_size; }
+
+    inline bool has(EntityID id) const
+    {
+        const Page* page = page_at(id / N);
+        return page && page->has(id % N);
+    }
+
+    inline const T& get(EntityID id) const
+    {
+        const Page* page = page_at(id / N);
+        ARK_ASSERT(page && page->has(id % N), "PagedStorage: Entity lookup failed for "
+                                                  << detail::type_name<T>()
+                                                  << " with entity: " << id);
+        return *page->at(id % N);
+    }
+
+    inline T& get(EntityID id)
+    {
+        Page* page = writable_page(id / N);
+        ARK_ASSERT(page && page->has(id % N), "PagedStorage: Entity lookup failed for "
+                                                  << detail::type_name<T>()
+                                                  << " with entity: " << id);
+        return *page->at(id % N);
+    }
+
+    inline T* get_if(EntityID id) { return has(id) ? std::addressof(get(id)) : nullptr; }
+
+    template <typename... Args>
+    T& attach(EntityID id, Args&&... args)
+    {
+        assert(!has(id) && "Attempted to attach component to entity that already "
+                           "posesses that component.");
+
+        const size_t index = id / N;
+        grow_page_table(index + 1);
+
+        Page* page = writable_page(index);
+        if (!page) {
+            page = new Page();
+            set_entry(m_pages[index], page, true);
+        }
+
+        T* component = new (page->at(id % N)) T(std::forward<Args>(args)...);
+        page->set(id % N);
+        page->count++;
+        m_size++;
+        return *component;
+    }
+
+    void detach(EntityID id)
+    {
+        const size_t index = id / N;
+        Page* page = page_at(index);
+        ARK_ASSERT(page && page->has(id % N), "PagedStorage: detach failed for "
+                                                  << detail::type_name<T>()
+                                                  << " with entity: " << id);
+
+        // no need to copy a shared page only to free it right away
+        if (page->count == 1) {
+            set_entry(m_pages[index], nullptr, false);
+            release(page);
+            m_size--;
+            return;
+        }
+
+        page = writable_page(index);
+        page->at(id % N)->~T();
+        page->unset(id % N);
+        page->count--;
+        m_size--;
+    }
+
+    // Make this storage share all pages of 'other', copy-on-write, see World::clone_into.
+    // Pages 'other' owned are now shared, so its writers have to check them again.
+    void copy_from(const PagedStorage& other)
+    {
+        if (&other == this) return;
+
+        release_all();
+        grow_page_table(other.m_num_pages);
+        for (size_t i = 0; i < other.m_num_pages; i++) {
+            Page* page = other.page_at(i);
+            if (page) page->refs.fetch_add(1, std::memory_order_relaxed);
+            other.m_pages[i].owned.store(false, std::memory_order_release);
+            set_entry(m_pages[i], page, false);
+        }
+        m_size = other.m_size;
+    }
+
+    // Call 'f(std::span<const EntityID>, std::span<const T>)' for each run of consecutive
+    // occupied slots of each page, in EntityID order. The components are read in place, only
+    // their IDs are spelled out. See World::for_each_column_chunk.
+    template <typename Callable>
+    void for_each_chunk(Callable&& f) const
+    {
+        std::array<EntityID, N> ids;
+        for (size_t index = 0; index < m_num_pages; index++) {
+            const Page* page = page_at(index);
+            if (!page) continue;
+
+            size_t slot = 0;
+            while (slot < N) {
+                if (!page->has(slot)) {
+                    slot++;
+                    continue;
+                }
+                const size_t start = slot;
+                while (slot < N && page->has(slot)) {
+                    ids[slot - start] = static_cast<EntityID>(index * N + slot);
+                    slot++;
+                }
+                f(std::span<const EntityID>(ids.data(), slot - start),
+                  std::span<const T>(page->at(start), slot - start));
+            }
+        }
+    }
+
+    // Drop the part of the page table past the last page in use.
+    void shrink_to_fit(void)
+    {
+        size_t used = m_num_pages;
+        while (used > 0 && !page_at(used - 1)) {
+            used--;
+        }
+        if (used < m_num_pages) resize_page_table(used);
+    }
+
+    // Pages shared with other storages are counted in full, as if this storage owned them.
+    StorageMemoryStats memory_stats(void) const
+    {
+        size_t num_pages = 0;
+        for (size_t i = 0; i < m_num_pages; i++) {
+            num_pages += page_at(i) != nullptr;
+        }
+
+        StorageMemoryStats stats;
+        stats.live = m_size;
+        stats.capacity = num_pages * N;
+        stats.data_bytes = num_pages * sizeof(T) * N;
+        stats.key_bytes = m_num_pages * sizeof(Entry);
+        stats.slot_id_bytes = num_pages * (sizeof(Page) - sizeof(T) * N);
+        return stats;
+    }
+
+    // number of pages currently shared with at least one other storage
+    size_t shared_pages(void) const
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < m_num_pages; i++) {
+            const Page* page = page_at(i);
+            count += page && page->refs.load(std::memory_order_relaxed) > 1;
+        }
+        return count;
+    }
+
+    // Hot path counters, see ark/stats.hpp.
+    inline StatsSnapshot counters(void) const { return m_stats.snapshot(); }
+    inline void reset_counters(void) { m_stats.reset(); }
+};
+
+} // namespace ark
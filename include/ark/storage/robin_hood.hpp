@@ -2,12 +2,23 @@
 
 #include "ark/prelude.hpp"
 #include "ark/flat_hash_map.hpp"
+#include "ark/memory_report.hpp"
+#include "ark/snapshot.hpp"
+#include "ark/stats.hpp"
+
+#include <memory_resource>
+#include <optional>
+#include <span>
 
 namespace ark {
 
 template <typename T>
 class RobinHoodStorage {
     EntityMap<T> m_map;
+
+    // maintenance shrinks the map when it is less than this full
+    static constexpr double MIN_LOAD_FACTOR = 0.125;
+
 public:
     using ComponentType = T;
 
@@ -37,6 +48,95 @@ public:
         return *val;
     }
 
+    inline void reserve(size_t count) {
+        m_map.reserve(count);
+    }
+
+    inline void set_incremental_rehash(bool enabled) {
+        m_map.set_incremental_rehash(enabled);
+    }
+
+    inline void set_memory_resource(std::pmr::memory_resource* resource) {
+        m_map.set_memory_resource(resource);
+    }
+
+    // The map only ever grows on its own, so maintenance consists of shrinking it back down
+    // once it is mostly empty.
+    std::optional<double> estimate_maintenance_time(void) const {
+        if (m_map.load_factor() < MIN_LOAD_FACTOR) {
+            return 1e-8 * (double)m_map.size();
+        }
+        else {
+            return {};
+        }
+    }
+
+    void maintenance(void) {
+        m_map.shrink_to_fit();
+    }
+
+    void shrink_to_fit(void) {
+        m_map.shrink_to_fit();
+    }
+
+    StorageMemoryStats memory_stats(void) const {
+        StorageMemoryStats stats;
+        stats.map = m_map.stats();
+        stats.live = m_map.size();
+        stats.capacity = m_map.capacity();
+        stats.data_bytes = m_map.capacity() * sizeof(T);
+        stats.key_bytes = m_map.capacity() * sizeof(EntityID);
+        return stats;
+    }
+
+    // Make this storage a copy of 'other', see World::clone_into.
+    inline void copy_from(const RobinHoodStorage& other) {
+        m_map.copy_from(other.m_map);
+    }
+
+    // Runs of components stored next to each other, see World::for_each_column_chunk.
+    template <typename Callable>
+    inline void for_each_chunk(Callable&& f) const {
+        m_map.for_each_run(f);
+    }
+
+    // Snapshots, see ark/snapshot.hpp. The map's tables are dumped as they are.
+    void save(SnapshotWriter& out) const {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "RobinHoodStorage: only trivially copyable components can be saved");
+        out.write<uint64_t>(sizeof(T));
+        m_map.save(out);
+    }
+
+    bool load(SnapshotReader& in) {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "RobinHoodStorage: only trivially copyable components can be loaded");
+        if (in.read<uint64_t>() != sizeof(T)) in.fail();
+        if (!in.ok()) {
+            m_map.clear();
+            return false;
+        }
+        return m_map.load(in);
+    }
+
+    // Hot path counters of the underlying map, see ark/stats.hpp.
+    StatsSnapshot counters(void) const {
+        return m_map.counters();
+    }
+
+    void reset_counters(void) {
+        m_map.reset_counters();
+    }
+
+    // Bulk attach, see ark::detail::attach_all.
+    template <typename Generator>
+    void attach_all(std::span<const EntityID> ids, Generator&& generator) {
+        m_map.reserve(m_map.size() + ids.size());
+        for (const EntityID id : ids) {
+            m_map.insert(id, generator(id));
+        }
+    }
+
     inline void detach(EntityID id) {
         m_map.remove(id);
     }
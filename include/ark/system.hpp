@@ -1,14 +1,20 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <concepts>
-#include <future>
+#include <new>
+#include <span>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "ark/component.hpp"
 #include "ark/flat_entity_set.hpp"
-#include "ark/third_party/ThreadPool.hpp"
+#include "ark/frame_arena.hpp"
+#include "ark/prefab.hpp"
+#include "ark/replication.hpp"
+#include "ark/thread_pool.hpp"
 #include "ark/type_mask.hpp"
 
 namespace ark {
@@ -29,33 +35,112 @@ public:
 class FollowedEntities {
     FlatEntitySet* m_set;
     ThreadPool* m_thread_pool;
+    FrameArenas* m_frame_arenas;
 
-    std::vector<EntityRange> split(size_t n)
-    {
-        std::vector<EntityRange> result;
-        result.reserve(n);
+    // fixed number of entities per chunk of parallel operations, or 0 for one chunk per
+    // thread (see World::set_deterministic)
+    size_t m_chunk_size;
 
-        const size_t base = m_set->size() / n;
-        const size_t remainder = m_set->size() % n;
+    // per-chunk partial result of a parallel reduction, padded to its own cache line(s) so
+    // that workers accumulating into neighbouring partials don't false-share
+    template <typename T>
+    struct alignas(64) alignas(T) Partial {
+        T value;
+    };
 
-        EntityID* ptr = m_set->begin_ptr();
-        for (size_t i = 0; i < remainder; i++) {
-            EntityID* split_begin = ptr;
-            EntityID* split_end = ptr + base + 1;
-            result.push_back(EntityRange(split_begin, split_end));
-            ptr = split_end;
+    // Shared implementation of par_filter and par_partition.
+    // Each chunk is scanned into its own slice of a scratch buffer, then the per-chunk results
+    // are compacted into a single buffer at offsets given by a prefix sum of the chunk counts.
+    // Chunks are in order and the followed set is sorted, so both lists come out sorted.
+    // All of it lives in the calling thread's arena: which worker scans which chunk changes
+    // from frame to frame, so the workers' arenas would never settle on a size.
+    template <typename Predicate>
+    std::pair<std::span<const EntityID>, std::span<const EntityID>>
+    partition_impl(Predicate& pred, bool collect_rejected)
+    {
+        struct ChunkResult {
+            EntityID* accepted;
+            EntityID* rejected;
+            size_t num_accepted;
+            size_t num_rejected;
+            size_t accepted_offset;
+            size_t rejected_offset;
+        };
+
+        const size_t nchunks = num_chunks();
+        BumpAllocator& arena = m_frame_arenas->local();
+        ChunkResult* results = static_cast<ChunkResult*>(
+            arena.allocate(nchunks * sizeof(ChunkResult), alignof(ChunkResult)));
+
+        const size_t scratch_size = collect_rejected ? 2 * m_set->size() : m_set->size();
+        EntityID* scratch = static_cast<EntityID*>(
+            arena.allocate(scratch_size * sizeof(EntityID), alignof(EntityID)));
+
+        m_thread_pool->parallel_for(nchunks, [&](size_t ichunk) -> void {
+            const EntityRange range = chunk(ichunk, nchunks);
+            const size_t offset = range.begin() - m_set->begin_ptr();
+
+            ChunkResult& result = results[ichunk];
+            result.accepted = scratch + offset;
+            result.rejected = collect_rejected ? scratch + m_set->size() + offset : nullptr;
+            result.num_accepted = 0;
+            result.num_rejected = 0;
+
+            for (const EntityID id : range) {
+                if (pred(id)) {
+                    result.accepted[result.num_accepted++] = id;
+                }
+                else if (collect_rejected) {
+                    result.rejected[result.num_rejected++] = id;
+                }
+            }
+        });
+
+        size_t total_accepted = 0;
+        size_t total_rejected = 0;
+        for (size_t i = 0; i < nchunks; i++) {
+            results[i].accepted_offset = total_accepted;
+            results[i].rejected_offset = total_rejected;
+            total_accepted += results[i].num_accepted;
+            total_rejected += results[i].num_rejected;
         }
 
-        for (size_t i = remainder; i < n; i++) {
-            EntityID* split_begin = ptr;
-            EntityID* split_end = ptr + base;
-            result.push_back(EntityRange(split_begin, split_end));
-            ptr = split_end;
-        }
+        EntityID* output = static_cast<EntityID*>(arena.allocate(
+            (total_accepted + total_rejected) * sizeof(EntityID), alignof(EntityID)));
+        EntityID* rejected_output = output + total_accepted;
+
+        m_thread_pool->parallel_for(nchunks, [&](size_t ichunk) -> void {
+            const ChunkResult& result = results[ichunk];
+            std::copy(result.accepted, result.accepted + result.num_accepted,
+                      output + result.accepted_offset);
+            if (collect_rejected) {
+                std::copy(result.rejected, result.rejected + result.num_rejected,
+                          rejected_output + result.rejected_offset);
+            }
+        });
+
+        return {std::span<const EntityID>(output, total_accepted),
+                std::span<const EntityID>(rejected_output, total_rejected)};
+    }
 
-        assert(ptr == m_set->end_ptr());
+    // Number of chunks parallel operations split the followed entities into. In deterministic
+    // mode this only depends on the number of entities, never on the number of threads.
+    size_t num_chunks(void) const
+    {
+        if (m_chunk_size == 0) return m_thread_pool->nthreads();
+        return std::max(size_t(1), (m_set->size() + m_chunk_size - 1) / m_chunk_size);
+    }
 
-        return result;
+    // i-th of n contiguous, nearly equal sized chunks of the followed entities
+    EntityRange chunk(size_t i, size_t n) const
+    {
+        const size_t base = m_set->size() / n;
+        const size_t remainder = m_set->size() % n;
+
+        const size_t chunk_begin = i * base + std::min(i, remainder);
+        const size_t chunk_end = chunk_begin + base + (i < remainder ? 1 : 0);
+
+        return EntityRange(m_set->begin_ptr() + chunk_begin, m_set->begin_ptr() + chunk_end);
     }
 
 public:
@@ -74,27 +159,102 @@ public:
     template <typename Callable>
     void for_each_par(Callable&& f)
     {
-        // TODO: precompute ranges and only updated when followed entities change...?
-        const std::vector<EntityRange> ranges = split(m_thread_pool->nthreads());
+        const size_t nchunks = num_chunks();
 
-        std::vector<std::future<void>> results;
-        results.reserve(ranges.size());
+        m_thread_pool->parallel_for(nchunks, [this, nchunks, &f](size_t ichunk) -> void {
+            for (const EntityID id : chunk(ichunk, nchunks)) {
+                f(id);
+            }
+        });
+    }
+
+    // Parallel reduction over the followed entities.
+    // Each chunk of entities is folded into its own copy of 'identity' with
+    // 'accumulate(T& partial, EntityID id)', then the partials are folded together with
+    // 'combine(const T&, const T&) -> T', always in chunk order starting from 'identity'.
+    // The chunking only depends on the number of entities and threads, so for a given
+    // ThreadPool size the result is deterministic even for non-associative operations such
+    // as floating point addition. In deterministic mode (see World::set_deterministic) it
+    // doesn't depend on the number of threads either.
+    template <typename T, typename Accumulate, typename Combine>
+    T for_each_par_reduce(T identity, Accumulate&& accumulate, Combine&& combine)
+    {
+        const size_t nchunks = num_chunks();
+
+        // the partials live in the calling thread's frame arena, so a reduction doesn't
+        // touch the heap unless T itself does
+        Partial<T>* partials = static_cast<Partial<T>*>(m_frame_arenas->local().allocate(
+            nchunks * sizeof(Partial<T>), alignof(Partial<T>)));
 
-        for (const EntityRange& r : ranges) {
-            results.emplace_back(
-                m_thread_pool->enqueue([&r, func = std::forward<Callable>(f)]() -> void {
-                    for (const EntityID id : r) {
-                        func(id);
-                    }
-                }));
+        for (size_t i = 0; i < nchunks; i++) {
+            new (partials + i) Partial<T>{identity};
         }
 
-        for (auto&& result : results) {
-            result.get();
+        m_thread_pool->parallel_for(
+            nchunks, [this, nchunks, partials, &accumulate](size_t ichunk) -> void {
+                T& partial = partials[ichunk].value;
+                for (const EntityID id : chunk(ichunk, nchunks)) {
+                    accumulate(partial, id);
+                }
+            });
+
+        T result = std::move(identity);
+        for (size_t i = 0; i < nchunks; i++) {
+            result = combine(std::as_const(result), std::as_const(partials[i].value));
+            partials[i].~Partial<T>();
         }
+
+        return result;
+    }
+
+    // Parallel reduction of 'transform(EntityID) -> T' over the followed entities, in the
+    // spirit of std::transform_reduce. See for_each_par_reduce for the ordering guarantees.
+    template <typename T, typename Combine, typename Transform>
+    T transform_reduce(T identity, Combine&& combine, Transform&& transform)
+    {
+        return for_each_par_reduce(
+            std::move(identity),
+            [&combine, &transform](T& partial, EntityID id) -> void {
+                partial = combine(std::as_const(partial), transform(id));
+            },
+            combine);
+    }
+
+    // Number of followed entities for which 'pred(EntityID) -> bool' holds, evaluated in
+    // parallel.
+    template <typename Predicate>
+    size_t par_count_if(Predicate&& pred)
+    {
+        return for_each_par_reduce(
+            size_t(0),
+            [&pred](size_t& count, EntityID id) -> void {
+                if (pred(id)) count++;
+            },
+            [](size_t a, size_t b) -> size_t { return a + b; });
+    }
+
+    // The followed entities for which 'pred(EntityID) -> bool' holds, in sorted order.
+    // 'pred' is evaluated in parallel. The list lives in the frame arenas and stays valid
+    // until the run_systems_* call running the system returns.
+    template <typename Predicate>
+    std::span<const EntityID> par_filter(Predicate&& pred)
+    {
+        return partition_impl(pred, false).first;
     }
 
-    FollowedEntities(FlatEntitySet* s, ThreadPool* p) : m_set(s), m_thread_pool(p) {}
+    // Like par_filter, but also returns the followed entities for which 'pred' doesn't hold.
+    // Both lists are sorted.
+    template <typename Predicate>
+    std::pair<std::span<const EntityID>, std::span<const EntityID>>
+    par_partition(Predicate&& pred)
+    {
+        return partition_impl(pred, true);
+    }
+
+    FollowedEntities(FlatEntitySet* s, ThreadPool* p, FrameArenas* a, size_t chunk_size = 0)
+        : m_set(s), m_thread_pool(p), m_frame_arenas(a), m_chunk_size(chunk_size)
+    {
+    }
 };
 
 // clang-format off
@@ -107,6 +267,80 @@ concept System = requires
 };
 // clang-format on
 
+namespace detail {
+
+// Systems with identical Subscriptions necessarily follow identical sets of entities, so
+// ark::World stores one followed entity set per unique subscription mask (a 'follow group')
+// rather than one per system. The grouping is computed entirely at compile time.
+template <typename AllComponents, typename AllSystems>
+struct FollowGroups;
+
+template <typename AllComponents, typename... SystemTypes>
+struct FollowGroups<AllComponents, TypeList<SystemTypes...>> {
+    using ComponentMask = TypeMask<AllComponents>;
+
+    static constexpr size_t num_systems = sizeof...(SystemTypes);
+
+    static constexpr std::array<ComponentMask, num_systems> system_masks = {
+        ComponentMask(typename SystemTypes::Subscriptions())...};
+
+    static constexpr bool same_mask(const ComponentMask& a, const ComponentMask& b)
+    {
+        return a.is_subset_of(b) && b.is_subset_of(a);
+    }
+
+    // the group of each system is the index of the first system with the same mask,
+    // re-numbered so that group indices are contiguous.
+    static constexpr std::array<size_t, num_systems> compute_system_groups(void)
+    {
+        std::array<size_t, num_systems> groups = {};
+        size_t next_group = 0;
+        for (size_t i = 0; i < num_systems; i++) {
+            groups[i] = next_group;
+            for (size_t j = 0; j < i; j++) {
+                if (same_mask(system_masks[i], system_masks[j])) {
+                    groups[i] = groups[j];
+                    break;
+                }
+            }
+            if (groups[i] == next_group) next_group++;
+        }
+        return groups;
+    }
+
+    static constexpr std::array<size_t, num_systems> system_groups = compute_system_groups();
+
+    static constexpr size_t compute_num_groups(void)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < num_systems; i++) {
+            count = system_groups[i] + 1 > count ? system_groups[i] + 1 : count;
+        }
+        return count;
+    }
+
+    static constexpr size_t num_groups = compute_num_groups();
+
+    static constexpr std::array<ComponentMask, num_groups> compute_group_masks(void)
+    {
+        std::array<ComponentMask, num_groups> masks = {};
+        for (size_t i = 0; i < num_systems; i++) {
+            masks[system_groups[i]] = system_masks[i];
+        }
+        return masks;
+    }
+
+    static constexpr std::array<ComponentMask, num_groups> group_masks = compute_group_masks();
+
+    template <typename S>
+    static constexpr size_t group_of(void)
+    {
+        return system_groups[type_list::index<S, TypeList<SystemTypes...>>()];
+    }
+};
+
+} // namespace detail
+
 template <typename>
 struct RunFnArgs;
 
@@ -132,13 +366,23 @@ template <Component T>
 class WriteComponent {
     typename T::Storage* m_store;
 
+    // where writes are recorded for delta replication, only used by Replicable components
+    ChangeLog* m_changes;
+
 public:
     using ComponentType = T;
 
-    inline T& operator[](EntityID id) { return m_store->get(id); }
+    inline T& operator[](EntityID id)
+    {
+        if constexpr (Replicable<T>) m_changes->record(id);
+        return m_store->get(id);
+    }
 
     WriteComponent() = delete;
-    WriteComponent(typename T::Storage* store) : m_store(store) {}
+    WriteComponent(typename T::Storage* store, ChangeLog* changes = nullptr)
+        : m_store(store), m_changes(changes)
+    {
+    }
 };
 
 template <Component T>
@@ -155,6 +399,14 @@ public:
         m_world_update_queue->push_back(id);
     }
 
+    void detach_all(std::span<const EntityID> ids)
+    {
+        for (const EntityID id : ids) {
+            m_store->detach(id);
+        }
+        m_world_update_queue->insert(m_world_update_queue->end(), ids.begin(), ids.end());
+    }
+
     DetachComponent() = delete;
     DetachComponent(typename T::Storage* store, std::vector<EntityID>* world_update_queue)
         : m_store(store), m_world_update_queue(world_update_queue)
@@ -177,6 +429,21 @@ public:
         m_world_update_queue->push_back(id);
     }
 
+    // attach a copy of 'value' to each entity in 'ids'
+    void attach_all(std::span<const EntityID> ids, const T& value)
+    {
+        attach_all(ids, [&value](EntityID) -> const T& { return value; });
+    }
+
+    // attach 'generator(id)' to each entity in 'ids'
+    template <typename Generator>
+        requires std::invocable<Generator&, EntityID>
+    void attach_all(std::span<const EntityID> ids, Generator&& generator)
+    {
+        detail::attach_all(m_store, ids, generator);
+        m_world_update_queue->insert(m_world_update_queue->end(), ids.begin(), ids.end());
+    }
+
     AttachComponent() = delete;
     AttachComponent(typename T::Storage* store, std::vector<EntityID>* world_update_queue)
         : m_store(store), m_world_update_queue(world_update_queue)
@@ -211,6 +478,11 @@ public:
     EntityDestroyer(std::vector<EntityID>* death_row) : m_world_death_row(death_row) {}
 
     inline void operator()(const EntityID id) { m_world_death_row->push_back(id); }
+
+    inline void destroy(std::span<const EntityID> ids)
+    {
+        m_world_death_row->insert(m_world_death_row->end(), ids.begin(), ids.end());
+    }
 };
 
 template <typename AllComponents>
@@ -221,9 +493,48 @@ class EntityBuilder {
 
     Stash* m_world_stash;
     Roster* m_world_roster;
+    ThreadPool* m_thread_pool;
+
+    // the World's next unused EntityID
+    EntityID* m_next_id;
+
+    // Reserve 'count' consecutive EntityIDs and return the first one.
+    inline EntityID next_ids(size_t count)
+    {
+        const EntityID first = *m_next_id;
+        *m_next_id += static_cast<EntityID>(count);
+        return first;
+    }
+
+    // Reserve 'count' new entities with the component mask of 'Ts...' and return their IDs.
+    // The IDs are contiguous, and live at the end of the roster entry for the mask, so
+    // they are only valid until the next entity is built with the same mask.
+    template <Component... Ts>
+    std::span<const EntityID> new_entity_block(size_t count)
+    {
+        static constexpr ComponentMask mask = ComponentMask(TypeList<Ts...>());
+
+        std::vector<EntityID>& roster_entities = (*m_world_roster)[mask];
+        const size_t old_size = roster_entities.size();
+        const EntityID first_id = next_ids(count);
+
+        roster_entities.resize(old_size + count);
+        for (size_t i = 0; i < count; i++) {
+            roster_entities[old_size + i] = first_id + static_cast<EntityID>(i);
+        }
+
+        return std::span<const EntityID>(roster_entities.data() + old_size, count);
+    }
+
+    template <Component T>
+    static auto default_generator(void)
+    {
+        return [](EntityID) -> T { return T(); };
+    }
 
 public:
-    EntityBuilder(Stash* stash, Roster* roster) : m_world_stash(stash), m_world_roster(roster)
+    EntityBuilder(Stash* stash, Roster* roster, ThreadPool* pool, EntityID* next_id)
+        : m_world_stash(stash), m_world_roster(roster), m_thread_pool(pool), m_next_id(next_id)
     {
     }
 
@@ -234,8 +545,8 @@ public:
         Roster* m_world_roster;
 
     public:
-        EntitySkeleton(Stash* stash, Roster* roster)
-            : m_id(next_entity_id()), m_mask(), m_world_stash(stash), m_world_roster(roster)
+        EntitySkeleton(EntityID id, Stash* stash, Roster* roster)
+            : m_id(id), m_mask(), m_world_stash(stash), m_world_roster(roster)
         {
         }
 
@@ -253,7 +564,88 @@ public:
         ~EntitySkeleton(void) { (*m_world_roster)[m_mask].push_back(m_id); }
     };
 
-    EntitySkeleton new_entity(void) { return EntitySkeleton(m_world_stash, m_world_roster); }
+    EntitySkeleton new_entity(void)
+    {
+        return EntitySkeleton(next_ids(1), m_world_stash, m_world_roster);
+    }
+
+    // Create 'count' entities with exactly the components 'Ts...', where the component of type
+    // Ts attached to entity 'id' is given by the corresponding 'generators(id)'. Without any
+    // generators, components are default constructed.
+    // Compared to calling new_entity 'count' times, the component mask is known at compile
+    // time, the entities get a contiguous block of IDs, and each component storage is filled
+    // in a single batched pass (see ark::detail::attach_all).
+    // Returns the first ID of the block, the entities are 'first, first + 1, ..., first +
+    // count - 1'.
+    template <Component... Ts, typename... Generators>
+    EntityID spawn_batch(size_t count, Generators&&... generators)
+    {
+        static_assert(sizeof...(Generators) == 0 || sizeof...(Generators) == sizeof...(Ts),
+                      "EntityBuilder::spawn_batch: expected one generator per component type.");
+
+        const std::span<const EntityID> ids = new_entity_block<Ts...>(count);
+
+        if constexpr (sizeof...(Generators) == 0) {
+            (detail::attach_all(m_world_stash->template get<Ts>(), ids,
+                                default_generator<Ts>()),
+             ...);
+        }
+        else {
+            (detail::attach_all(m_world_stash->template get<Ts>(), ids, generators), ...);
+        }
+
+        return count > 0 ? ids.front() : 0;
+    }
+
+    // Create 'count' copies of 'prefab'. Returns the first ID of the new block of entities,
+    // as with spawn_batch. Each storage is filled with copies of the prefab's component in
+    // one pass (see ark::detail::attach_copies).
+    template <Component... Ts>
+    EntityID instantiate(const Prefab<Ts...>& prefab, size_t count)
+    {
+        const std::span<const EntityID> ids = new_entity_block<Ts...>(count);
+        (detail::attach_copies(m_world_stash->template get<Ts>(), ids,
+                               prefab.template get<Ts>()),
+         ...);
+        return count > 0 ? ids.front() : 0;
+    }
+
+    // Same as spawn_batch, but each component storage is filled by a separate task on the
+    // ThreadPool. Each generator is only ever called from one thread at a time.
+    template <Component... Ts, typename... Generators>
+    EntityID spawn_batch_par(size_t count, Generators&&... generators)
+    {
+        static_assert(sizeof...(Generators) == 0 || sizeof...(Generators) == sizeof...(Ts),
+                      "EntityBuilder::spawn_batch_par: expected one generator per component "
+                      "type.");
+
+        const std::span<const EntityID> ids = new_entity_block<Ts...>(count);
+
+        using FillFn = void (*)(EntityBuilder*, std::span<const EntityID>, void*);
+        std::array<FillFn, sizeof...(Ts)> fills;
+        std::array<void*, sizeof...(Ts)> contexts;
+
+        if constexpr (sizeof...(Generators) == 0) {
+            fills = {[](EntityBuilder* builder, std::span<const EntityID> block, void*) {
+                detail::attach_all(builder->m_world_stash->template get<Ts>(), block,
+                                   default_generator<Ts>());
+            }...};
+            contexts.fill(nullptr);
+        }
+        else {
+            fills = {[](EntityBuilder* builder, std::span<const EntityID> block, void* gen) {
+                detail::attach_all(builder->m_world_stash->template get<Ts>(), block,
+                                   *static_cast<std::remove_reference_t<Generators>*>(gen));
+            }...};
+            contexts = {const_cast<void*>(static_cast<const void*>(std::addressof(generators)))...};
+        }
+
+        m_thread_pool->parallel_for(sizeof...(Ts), [&](size_t i) -> void {
+            fills[i](this, ids, contexts[i]);
+        });
+
+        return count > 0 ? ids.front() : 0;
+    }
 };
 
 } // end namespace ark
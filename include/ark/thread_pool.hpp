@@ -0,0 +1,580 @@
+#pragma once
+
+#include "ark/allocation_tracking.hpp"
+#include "ark/cpu_topology.hpp"
+#include "ark/prelude.hpp"
+#include "ark/thread_pool_stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ark {
+
+// Tracks completion of a set of tasks submitted to a ThreadPool.
+// TaskGroups live on the stack of whoever submits the tasks and waits for them.
+class TaskGroup {
+    friend class ThreadPool;
+    std::atomic<size_t> m_remaining;
+
+public:
+    TaskGroup(void) : m_remaining(0) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup(TaskGroup&&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    TaskGroup& operator=(TaskGroup&&) = delete;
+
+    inline bool done(void) const { return m_remaining.load(std::memory_order_acquire) == 0; }
+};
+
+struct ThreadPoolOptions {
+    size_t nthreads = 1;
+
+    // see PinningPolicy and CpuTopology::worker_cpus
+    PinningPolicy pinning = PinningPolicy::None;
+
+    // Queue task i of every parallel_for (and so chunk i of every for_each_par, or the i-th
+    // system of run_systems_parallel) for the same worker every time, so the same worker
+    // touches the same data frame after frame and finds it still in its core's caches.
+    // Tasks queued for a worker that is busy running something else can still be stolen by
+    // idle threads, so this never leaves work waiting on a single thread.
+    bool sticky_tasks = false;
+};
+
+// A fixed-size pool of worker threads consuming queues of tasks.
+// Unlike a typical std::function/std::future based pool, a task here is just a function
+// pointer, a context pointer and an index, and completion is tracked with a TaskGroup
+// counter. Tasks go to a queue shared by all threads, or with sticky tasks enabled, to the
+// queue of a specific worker. Queues are ring buffers that only grow when more tasks are
+// queued at once than ever before, so submitting and waiting on work never allocates in
+// steady state.
+class ThreadPool {
+    static constexpr size_t INITIAL_QUEUE_CAPACITY = 1024;
+
+    struct Task {
+        void (*function)(void* context, size_t index);
+        void* context;
+        size_t index;
+        TaskGroup* group;
+        std::atomic<size_t>* allocation_counter;
+        uint64_t enqueue_ns; // only set when counting stats
+        size_t queue;        // index of the queue the task was pushed to
+    };
+
+    class TaskQueue {
+        std::vector<Task> m_tasks;
+        size_t m_head;
+        size_t m_size;
+
+    public:
+        TaskQueue(void) : m_tasks(INITIAL_QUEUE_CAPACITY), m_head(0), m_size(0) {}
+
+        inline size_t size(void) const { return m_size; }
+        inline bool empty(void) const { return m_size == 0; }
+
+        void push(const Task& task)
+        {
+            if (m_size == m_tasks.size()) {
+                std::vector<Task> larger(2 * m_tasks.size());
+                for (size_t i = 0; i < m_size; i++) {
+                    larger[i] = m_tasks[(m_head + i) % m_tasks.size()];
+                }
+                m_tasks.swap(larger);
+                m_head = 0;
+            }
+
+            m_tasks[(m_head + m_size) % m_tasks.size()] = task;
+            m_size++;
+        }
+
+        bool pop(Task& task)
+        {
+            if (m_size == 0) return false;
+            task = m_tasks[m_head];
+            m_head = (m_head + 1) % m_tasks.size();
+            m_size--;
+            return true;
+        }
+    };
+
+
+#ifdef ARK_ENABLE_STATS
+    static constexpr bool COUNT_STATS = true;
+#else
+    static constexpr bool COUNT_STATS = false;
+#endif
+
+    // Instrumentation of a single thread, see ark/thread_pool_stats.hpp. Only the owning
+    // thread writes to it, so the counters are atomic just to allow reading them at any time.
+    // The state at index 0 assumes one outside thread (normally the main thread) at a time.
+    struct alignas(64) ThreadState {
+        std::atomic<uint64_t> tasks_executed{0};
+        std::atomic<uint64_t> tasks_helped{0};
+        std::atomic<uint64_t> tasks_stolen{0};
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint64_t> idle_ns{0};
+        std::atomic<uint64_t> wait_ns{0};
+        std::atomic<uint64_t> queue_latency_ns{0};
+        std::atomic<uint64_t> max_queue_latency_ns{0};
+
+        // trace buffer, reserved up front by 'start_trace' so recording never allocates
+        std::vector<TaskEvent> events;
+        size_t dropped_events = 0;
+    };
+
+    // one per worker, plus index 0 for threads outside the pool
+    const size_t m_num_thread_states;
+    std::unique_ptr<ThreadState[]> m_thread_states;
+    const std::chrono::steady_clock::time_point m_epoch;
+    std::atomic<bool> m_tracing;
+
+    std::vector<std::thread> m_workers;
+    std::vector<int> m_worker_cpus; // empty if workers aren't pinned
+    const bool m_sticky_tasks;
+
+    // Index 0 is the shared queue, and index i the queue of worker i. All of them, as well
+    // as the rest of the scheduling state below, are protected by m_mutex.
+    std::vector<TaskQueue> m_queues;
+    size_t m_num_queued;
+    // whether each worker is currently running a task, in which case others may steal tasks
+    // from its queue
+    std::vector<uint8_t> m_busy;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_waiter_wakeup;
+    size_t m_num_waiting; // threads asleep in 'wait'
+    bool m_stop;
+
+    // only counted with ARK_ENABLE_STATS, and require m_mutex to be held
+    uint64_t m_tasks_submitted;
+    size_t m_max_queue_depth;
+
+    static inline thread_local size_t s_worker_index = 0;
+    static inline thread_local const ThreadPool* s_worker_pool = nullptr;
+
+    // The calling thread's index in this pool, or 0 if it isn't one of its workers.
+    inline size_t self(void) const { return s_worker_pool == this ? s_worker_index : 0; }
+
+    // requires m_mutex to be held
+    void push(const Task& task)
+    {
+        m_queues[task.queue].push(task);
+        m_num_queued++;
+
+        if constexpr (COUNT_STATS) {
+            m_tasks_submitted++;
+            m_max_queue_depth = std::max(m_max_queue_depth, m_num_queued);
+        }
+    }
+
+    // Whether thread 'self' may run the task at the front of queue 'queue'.
+    // requires m_mutex to be held
+    inline bool can_take_from(size_t self, size_t queue) const
+    {
+        return queue == 0 || queue == self || m_busy[queue];
+    }
+
+    // requires m_mutex to be held
+    bool has_work_for(size_t self) const
+    {
+        if (m_num_queued == 0) return false;
+        for (size_t queue = 0; queue < m_queues.size(); queue++) {
+            if (!m_queues[queue].empty() && can_take_from(self, queue)) return true;
+        }
+        return false;
+    }
+
+    // Pop a task for thread 'self': from its own queue first, then the shared queue, then
+    // from the queues of busy workers.
+    // requires m_mutex to be held
+    bool pop(size_t self, Task& task)
+    {
+        if (m_num_queued == 0) return false;
+
+        bool found = (self != 0 && m_queues[self].pop(task)) || m_queues[0].pop(task);
+        for (size_t i = 1; !found && i < m_queues.size(); i++) {
+            const size_t victim = (self + i) % m_queues.size();
+            found = victim != 0 && m_busy[victim] && m_queues[victim].pop(task);
+        }
+
+        if (found) m_num_queued--;
+        return found;
+    }
+
+    inline uint64_t now_ns(void) const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - m_epoch)
+            .count();
+    }
+
+    inline bool tracing(void) const { return m_tracing.load(std::memory_order_relaxed); }
+
+    // Threads of other pools calling into this one share index 0 with non-pool threads.
+    inline ThreadState& thread_state(void) { return m_thread_states[self()]; }
+
+    static inline void count(std::atomic<uint64_t>& counter, uint64_t amount)
+    {
+        counter.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    void record_event(TaskEventType type, size_t index, const void* group, uint64_t time)
+    {
+        ThreadState& state = thread_state();
+        if (state.events.size() < state.events.capacity()) {
+            const uint32_t thread = (uint32_t)(&state - m_thread_states.get());
+            state.events.push_back(TaskEvent{time, index, group, thread, type});
+        }
+        else {
+            state.dropped_events++;
+        }
+    }
+
+    // 'helping' is true for tasks run by a thread waiting on a TaskGroup
+    void execute(const Task& task, bool helping)
+    {
+        const bool trace = tracing();
+        const bool timed = COUNT_STATS || trace;
+
+        const uint64_t start_ns = timed ? now_ns() : 0;
+        if (trace) record_event(TaskEventType::Start, task.index, task.group, start_ns);
+
+        {
+            detail::AllocationScope scope(task.allocation_counter);
+            task.function(task.context, task.index);
+        }
+
+        // must happen before the group is marked done, as the waiter might stop tracing
+        if (timed) {
+            const uint64_t end_ns = now_ns();
+            if (trace) record_event(TaskEventType::End, task.index, task.group, end_ns);
+
+            if constexpr (COUNT_STATS) {
+                ThreadState& state = thread_state();
+                const uint64_t latency = start_ns - std::min(start_ns, task.enqueue_ns);
+                count(state.tasks_executed, 1);
+                count(state.tasks_helped, helping ? 1 : 0);
+                count(state.tasks_stolen, task.queue != 0 && task.queue != self() ? 1 : 0);
+                count(state.busy_ns, end_ns - start_ns);
+                count(state.queue_latency_ns, latency);
+                if (latency > state.max_queue_latency_ns.load(std::memory_order_relaxed)) {
+                    state.max_queue_latency_ns.store(latency, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        if (task.group->m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            // lock so that a waiter can't miss the notification between checking its
+            // group and going to sleep
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_waiter_wakeup.notify_all();
+        }
+    }
+
+    void worker_loop(size_t index)
+    {
+        s_worker_index = index;
+        s_worker_pool = this;
+
+        if (!m_worker_cpus.empty()) {
+            CpuTopology::pin_this_thread(m_worker_cpus[index - 1]);
+        }
+
+        while (true) {
+            Task task{};
+            bool now_stealable = false;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_busy[index] = false;
+
+                const uint64_t idle_start = COUNT_STATS ? now_ns() : 0;
+                m_work_available.wait(lock,
+                                      [this, index] { return m_stop || has_work_for(index); });
+                if constexpr (COUNT_STATS) {
+                    count(thread_state().idle_ns, now_ns() - idle_start);
+                }
+
+                if (!pop(index, task)) return; // stopping, with nothing left to do
+                m_busy[index] = true;
+                now_stealable = !m_queues[index].empty();
+            }
+
+            // the rest of this worker's queue can now be stolen by threads that had to
+            // leave it alone so far
+            if (now_stealable) {
+                m_work_available.notify_all();
+                m_waiter_wakeup.notify_all();
+            }
+
+            execute(task, false);
+        }
+    }
+
+    template <typename Callable>
+    static void call_with_index(void* context, size_t index)
+    {
+        (*static_cast<std::remove_reference_t<Callable>*>(context))(index);
+    }
+
+public:
+    explicit ThreadPool(const ThreadPoolOptions& options)
+        : m_num_thread_states(options.nthreads + 1),
+          m_thread_states(new ThreadState[options.nthreads + 1]),
+          m_epoch(std::chrono::steady_clock::now()), m_tracing(false), m_workers(),
+          m_worker_cpus(CpuTopology::system().worker_cpus(options.nthreads, options.pinning,
+                                                          CpuTopology::current_cpu())),
+          m_sticky_tasks(options.sticky_tasks), m_queues(options.nthreads + 1),
+          m_num_queued(0), m_busy(options.nthreads + 1, 0), m_num_waiting(0), m_stop(false),
+          m_tasks_submitted(0), m_max_queue_depth(0)
+    {
+        ARK_ASSERT(options.nthreads > 0, "Attempted to create ThreadPool with zero threads.");
+        m_workers.reserve(options.nthreads);
+        for (size_t i = 1; i <= options.nthreads; i++) {
+            m_workers.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    explicit ThreadPool(size_t nthreads) : ThreadPool(ThreadPoolOptions{.nthreads = nthreads})
+    {
+    }
+
+    // One worker per physical core, minus one for the thread driving the pool.
+    // SMT siblings share a core's caches and execution units, so extra workers on them
+    // mostly add contention for data-parallel loops like for_each_par.
+    static size_t default_nthreads(void)
+    {
+        const size_t cores = CpuTopology::system().num_cores();
+        return cores > 1 ? cores - 1 : 1;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    ~ThreadPool(void)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_work_available.notify_all();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    inline size_t nthreads(void) const { return m_workers.size(); }
+
+    // The CPU worker i (from 1) is pinned to, or -1 if workers aren't pinned.
+    inline int worker_cpu(size_t i) const
+    {
+        return m_worker_cpus.empty() ? -1 : m_worker_cpus[i - 1];
+    }
+
+    // Index of the calling thread within this pool, starting from 1. Threads that aren't
+    // workers of this pool, such as the main thread or the workers of another World's pool
+    // running this World's systems, get index 0.
+    inline size_t worker_index(void) const { return self(); }
+
+    // Queue f(0), f(1), ..., f(count - 1) to be run on the pool as part of 'group'.
+    // 'f' is referenced, not copied, and must stay alive until the group is waited on.
+    template <typename Callable>
+    inline void submit(TaskGroup& group, size_t count, Callable& f)
+    {
+        submit_to_workers(group, count, f, m_sticky_tasks);
+    }
+
+    // Same as submit, but 'sticky' decides whether task i is queued for worker 1 + i % n or
+    // for any thread, regardless of ThreadPoolOptions::sticky_tasks.
+    template <typename Callable>
+    void submit_to_workers(TaskGroup& group, size_t count, Callable& f, bool sticky)
+    {
+        if (count == 0) return;
+
+        group.m_remaining.fetch_add(count, std::memory_order_relaxed);
+
+        const bool trace = tracing();
+        const uint64_t enqueue_ns = COUNT_STATS || trace ? now_ns() : 0;
+        if (trace) record_event(TaskEventType::Enqueue, count, &group, enqueue_ns);
+
+        bool wake_waiters = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t i = 0; i < count; i++) {
+                const size_t queue = sticky ? 1 + i % nthreads() : 0;
+                push(Task{&call_with_index<Callable>,
+                          const_cast<void*>(static_cast<const void*>(std::addressof(f))), i,
+                          &group, detail::thread_allocation_counter, enqueue_ns, queue});
+            }
+            wake_waiters = m_num_waiting > 0;
+        }
+
+        // a sticky task has to wake up its own worker in particular
+        if (count == 1 && !sticky) {
+            m_work_available.notify_one();
+        }
+        else {
+            m_work_available.notify_all();
+        }
+
+        if (wake_waiters) {
+            m_waiter_wakeup.notify_all();
+        }
+    }
+
+    // Wait until every task in 'group' has finished.
+    // Rather than blocking, the waiting thread executes queued tasks (from any group) in the
+    // meantime. This makes nested parallelism safe: a system running on a worker thread can
+    // call for_each_par and wait on its sub-tasks without tying up a worker, so even if every
+    // worker is waiting on sub-tasks, all of the queued work still gets done.
+    // The waiting thread only sleeps when there is nothing it can take from the queues, in
+    // which case all remaining tasks of the group are already being run by, or queued for,
+    // other threads that aren't busy.
+    void wait(TaskGroup& group)
+    {
+        const size_t me = self();
+        while (!group.done()) {
+            Task task{};
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (!pop(me, task)) {
+                    const bool trace = tracing();
+                    const bool timed = COUNT_STATS || trace;
+                    const uint64_t wait_start = timed ? now_ns() : 0;
+                    if (trace) record_event(TaskEventType::WaitBegin, 0, &group, wait_start);
+
+                    m_num_waiting++;
+                    m_waiter_wakeup.wait(lock,
+                                         [&] { return group.done() || has_work_for(me); });
+                    m_num_waiting--;
+
+                    if (timed) {
+                        const uint64_t wait_end = now_ns();
+                        if (trace) record_event(TaskEventType::WaitEnd, 0, &group, wait_end);
+                        if constexpr (COUNT_STATS) {
+                            count(thread_state().wait_ns, wait_end - wait_start);
+                        }
+                    }
+                    continue;
+                }
+            }
+            execute(task, true);
+        }
+    }
+
+    // Run f(0), ..., f(count - 1) on the pool and wait for all of them to finish.
+    template <typename Callable>
+    void parallel_for(size_t count, Callable&& f)
+    {
+        TaskGroup group;
+        submit(group, count, f);
+        wait(group);
+    }
+
+    // Run f(1), ..., f(nthreads()) with each f(i) on worker i, and wait for all of them.
+    // Tasks queued for a worker are only stolen while that worker is busy, so as long as the
+    // pool isn't running anything else, every call really does run on its own worker.
+    template <typename Callable>
+    void for_each_worker(Callable&& f)
+    {
+        auto on_worker = [&f](size_t i) { f(i + 1); };
+        TaskGroup group;
+        submit_to_workers(group, nthreads(), on_worker, true);
+        wait(group);
+    }
+
+    // Per-thread counters, only counted when ARK_ENABLE_STATS is defined.
+    ThreadPoolStats stats(void) const
+    {
+        ThreadPoolStats result;
+        result.threads.resize(m_num_thread_states);
+        for (size_t i = 0; i < m_num_thread_states; i++) {
+            const ThreadState& state = m_thread_states[i];
+            ThreadPoolWorkerStats& t = result.threads[i];
+            t.tasks_executed = state.tasks_executed.load(std::memory_order_relaxed);
+            t.tasks_helped = state.tasks_helped.load(std::memory_order_relaxed);
+            t.tasks_stolen = state.tasks_stolen.load(std::memory_order_relaxed);
+            t.busy_ns = state.busy_ns.load(std::memory_order_relaxed);
+            t.idle_ns = state.idle_ns.load(std::memory_order_relaxed);
+            t.wait_ns = state.wait_ns.load(std::memory_order_relaxed);
+            t.queue_latency_ns = state.queue_latency_ns.load(std::memory_order_relaxed);
+            t.max_queue_latency_ns =
+                state.max_queue_latency_ns.load(std::memory_order_relaxed);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        result.tasks_submitted = m_tasks_submitted;
+        result.max_queue_depth = m_max_queue_depth;
+        return result;
+    }
+
+    // Only call while no tasks are in flight, like the rest of the tracing methods below.
+    void reset_stats(void)
+    {
+        for (size_t i = 0; i < m_num_thread_states; i++) {
+            ThreadState& state = m_thread_states[i];
+            for (std::atomic<uint64_t>* counter :
+                 {&state.tasks_executed, &state.tasks_helped, &state.tasks_stolen,
+                  &state.busy_ns, &state.idle_ns, &state.wait_ns, &state.queue_latency_ns,
+                  &state.max_queue_latency_ns}) {
+                counter->store(0, std::memory_order_relaxed);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks_submitted = 0;
+        m_max_queue_depth = 0;
+    }
+
+    // Start recording task events, discarding any previously recorded ones. Each thread
+    // records up to 'max_events_per_thread' events, after which further events are dropped.
+    void start_trace(size_t max_events_per_thread)
+    {
+        for (size_t i = 0; i < m_num_thread_states; i++) {
+            ThreadState& state = m_thread_states[i];
+            state.events.clear();
+            state.events.reserve(max_events_per_thread);
+            state.dropped_events = 0;
+        }
+        m_tracing.store(true, std::memory_order_relaxed);
+    }
+
+    inline void stop_trace(void) { m_tracing.store(false, std::memory_order_relaxed); }
+
+    // All events recorded since the last 'start_trace', ordered by time.
+    std::vector<TaskEvent> trace_events(void) const
+    {
+        std::vector<TaskEvent> events;
+        for (size_t i = 0; i < m_num_thread_states; i++) {
+            const std::vector<TaskEvent>& thread_events = m_thread_states[i].events;
+            events.insert(events.end(), thread_events.begin(), thread_events.end());
+        }
+        std::stable_sort(events.begin(), events.end(),
+                         [](const TaskEvent& a, const TaskEvent& b) {
+                             return a.timestamp_ns < b.timestamp_ns;
+                         });
+        return events;
+    }
+
+    // events that didn't fit into the trace buffers
+    size_t dropped_trace_events(void) const
+    {
+        size_t dropped = 0;
+        for (size_t i = 0; i < m_num_thread_states; i++) {
+            dropped += m_thread_states[i].dropped_events;
+        }
+        return dropped;
+    }
+};
+
+} // end namespace ark
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ark/prelude.hpp"
+
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <span>
+#include <vector>
+
+// ThreadPool instrumentation.
+// With ARK_ENABLE_STATS defined, every thread executing ThreadPool tasks keeps counters of how
+// many tasks it ran, how long they waited in the queue, and how its time splits between
+// running tasks, sleeping while waiting for work and blocking in ThreadPool::wait.
+// Independently of that, a ThreadPool can record a timestamped trace of task events at
+// runtime (see ThreadPool::start_trace), which write_chrome_trace dumps in the Chrome trace
+// event format, viewable in chrome://tracing or https://ui.perfetto.dev.
+
+namespace ark {
+
+// Counters of a single thread. Thread 0 stands for all threads outside the pool (normally
+// the main thread), which only run tasks while waiting on a TaskGroup.
+struct ThreadPoolWorkerStats {
+    uint64_t tasks_executed = 0;
+    uint64_t tasks_helped = 0;         // ...of which were run while waiting on a TaskGroup
+    uint64_t tasks_stolen = 0;         // ...of which were queued for another worker
+    uint64_t busy_ns = 0;              // time spent running tasks
+    uint64_t idle_ns = 0;              // time spent asleep with an empty queue (workers only)
+    uint64_t wait_ns = 0;              // time spent asleep in ThreadPool::wait
+    uint64_t queue_latency_ns = 0;     // summed time between tasks being queued and started
+    uint64_t max_queue_latency_ns = 0; // longest time any task waited in the queue
+
+    inline double mean_queue_latency_ns(void) const
+    {
+        return tasks_executed == 0 ? 0.0 : (double)queue_latency_ns / (double)tasks_executed;
+    }
+};
+
+struct ThreadPoolStats {
+    std::vector<ThreadPoolWorkerStats> threads; // index 0 is threads outside the pool
+    uint64_t tasks_submitted = 0;
+    size_t max_queue_depth = 0;
+
+    friend std::ostream& operator<<(std::ostream& os, const ThreadPoolStats& stats)
+    {
+        const auto ms = [](uint64_t ns) { return (double)ns / 1e6; };
+
+        const std::ios_base::fmtflags old_flags = os.flags();
+        const std::streamsize old_precision = os.precision();
+        os << std::fixed << std::setprecision(3);
+
+        os << "thread pool: " << stats.tasks_submitted << " tasks submitted, max queue depth "
+           << stats.max_queue_depth << std::endl;
+        for (size_t i = 0; i < stats.threads.size(); i++) {
+            const ThreadPoolWorkerStats& t = stats.threads[i];
+            os << "  thread " << i << ": " << t.tasks_executed << " tasks (" << t.tasks_helped
+               << " while waiting, " << t.tasks_stolen << " stolen), busy " << ms(t.busy_ns)
+               << " ms, idle " << ms(t.idle_ns) << " ms, waiting " << ms(t.wait_ns)
+               << " ms, queue latency mean "
+               << t.mean_queue_latency_ns() / 1e6 << " ms max " << ms(t.max_queue_latency_ns)
+               << " ms" << std::endl;
+        }
+
+        os.flags(old_flags);
+        os.precision(old_precision);
+        return os;
+    }
+};
+
+enum class TaskEventType : uint8_t {
+    Enqueue,   // tasks were queued, 'index' holds how many
+    Start,     // a thread started running task number 'index' of its group
+    End,       // ...and finished it
+    WaitBegin, // a thread went to sleep in ThreadPool::wait
+    WaitEnd,   // ...and woke up again
+};
+
+struct TaskEvent {
+    uint64_t timestamp_ns; // since the ThreadPool was created
+    size_t index;
+    const void* group; // the TaskGroup involved, only used to tell groups apart
+    uint32_t thread;   // see ThreadPoolWorkerStats
+    TaskEventType type;
+};
+
+// Write 'events' as a Chrome trace event JSON document, with one track per thread.
+inline void write_chrome_trace(std::ostream& os, std::span<const TaskEvent> events)
+{
+    const std::ios_base::fmtflags old_flags = os.flags();
+    const std::streamsize old_precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for (const TaskEvent& event : events) {
+        os << (first ? "\n" : ",\n");
+        first = false;
+
+        const char* name = "task";
+        const char* phase = "B";
+        switch (event.type) {
+        case TaskEventType::Enqueue:
+            name = "enqueue";
+            phase = "i";
+            break;
+        case TaskEventType::Start:
+            break;
+        case TaskEventType::End:
+            phase = "E";
+            break;
+        case TaskEventType::WaitBegin:
+            name = "wait";
+            break;
+        case TaskEventType::WaitEnd:
+            name = "wait";
+            phase = "E";
+            break;
+        }
+
+        // Chrome trace timestamps are in microseconds
+        os << "{\"name\":\"" << name << "\",\"ph\":\"" << phase << "\",\"pid\":0,\"tid\":"
+           << event.thread << ",\"ts\":" << (double)event.timestamp_ns / 1e3;
+        if (event.type == TaskEventType::Enqueue) {
+            os << ",\"s\":\"t\",\"args\":{\"count\":" << event.index << "}";
+        }
+        else if (event.type == TaskEventType::Start) {
+            os << ",\"args\":{\"index\":" << event.index << ",\"group\":\"" << event.group
+               << "\"}";
+        }
+        os << "}";
+    }
+    os << "\n]}" << std::endl;
+
+    os.flags(old_flags);
+    os.precision(old_precision);
+}
+
+} // end namespace ark
@@ -0,0 +1,96 @@
+#include "ark/ark.hpp"
+#include "ark/storage/bucket_array.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+using namespace ark;
+
+#ifndef ARK_TRACK_ALLOCATIONS
+#error "this test must be built with ARK_TRACK_ALLOCATIONS"
+#endif
+
+struct Position {
+    float x = 0.f;
+    using Storage = BucketArrayStorage<Position, 1024>;
+};
+
+struct Velocity {
+    float dx = 1.f;
+    using Storage = BucketArrayStorage<Velocity, 1024>;
+};
+
+using Components = TypeList<Position, Velocity>;
+
+inline std::atomic<size_t> fast_entities = 0;
+
+struct Move {
+    using Subscriptions = TypeList<Position, Velocity>;
+
+    static void run(FollowedEntities followed, WriteComponent<Position> position,
+                    ReadComponent<Velocity> velocity)
+    {
+        followed.for_each_par([&](EntityID id) { position[id].x += velocity[id].dx; });
+    }
+};
+
+struct Survey {
+    using Subscriptions = TypeList<Velocity>;
+
+    static void run(FollowedEntities followed, ReadComponent<Velocity> velocity)
+    {
+        const float total = followed.for_each_par_reduce(
+            0.f, [&](float& sum, EntityID id) { sum += velocity[id].dx; },
+            [](float a, float b) { return a + b; });
+        const std::span<const EntityID> fast =
+            followed.par_filter([&](EntityID id) { return velocity[id].dx > 1.5f; });
+        fast_entities = total > 0.f ? fast.size() : 0;
+    }
+};
+
+using TestWorld = World<Components, TypeList<Move, Survey>>;
+
+constexpr size_t NUM_ENTITIES = 50000;
+constexpr int WARMUP_FRAMES = 5;
+constexpr int FRAMES = 20;
+
+// Once the frame arenas, followed sets and thread pool queues have grown to what a frame
+// needs, running the same systems again must not touch the heap.
+void steady_state_frames_allocation_free(void)
+{
+    TestWorld world(4);
+    world.build_entities([](EntityBuilder<Components> builder) {
+        builder.spawn_batch<Position, Velocity>(
+            NUM_ENTITIES, [](EntityID) { return Position{}; },
+            [](EntityID id) { return Velocity{float(id % 3)}; });
+    });
+
+    for (int frame = 0; frame < WARMUP_FRAMES; frame++) {
+        world.run_systems_sequential<Move, Survey>();
+        world.run_systems_parallel<Move, Survey>();
+    }
+
+    for (int frame = 0; frame < FRAMES; frame++) {
+        world.run_systems_sequential<Move, Survey>();
+        ARK_CHECK(world.allocations_last_run<Move>() == 0);
+        ARK_CHECK(world.allocations_last_run<Survey>() == 0);
+
+        world.run_systems_parallel<Move, Survey>();
+        ARK_CHECK(world.allocations_last_run<Move>() == 0);
+        ARK_CHECK(world.allocations_last_run<Survey>() == 0);
+    }
+
+    std::vector<EntityID> ids;
+    std::vector<Velocity> velocities;
+    world.export_column(ids, velocities);
+    ARK_CHECK(fast_entities == size_t(std::count_if(velocities.begin(), velocities.end(),
+                                                    [](Velocity v) { return v.dx > 1.5f; })));
+}
+
+int main(void)
+{
+    steady_state_frames_allocation_free();
+    return ark_test_result();
+}
@@ -0,0 +1,87 @@
+#include "ark/ark.hpp"
+#include "ark/storage/paged.hpp"
+#include "test.hpp"
+
+#include <memory>
+#include <span>
+#include <vector>
+
+using namespace ark;
+
+struct Position {
+    float x = 0.f;
+    float y = 0.f;
+    using Storage = PagedStorage<Position>;
+};
+
+struct Velocity {
+    float dx = 0.f;
+    using Storage = PagedStorage<Velocity>;
+};
+
+using Components = TypeList<Position, Velocity>;
+
+struct Idle {
+    using Subscriptions = TypeList<>;
+    static void run(FollowedEntities) {}
+};
+
+using TestWorld = World<Components, TypeList<Idle>>;
+
+constexpr size_t NUM_ENTITIES = 100000;
+
+// import_columns scatters blocks of entities from several threads at once, all writing to
+// pages the forked World still shares with its parent. Each page must be copied before it
+// is written, and the parent must never see the imported values.
+void import_into_fork_leaves_parent_unchanged(void)
+{
+    std::unique_ptr<TestWorld> parent(
+        TestWorld::init([](auto&) {}, ThreadPoolOptions{.nthreads = 4}));
+    parent->build_entities([](EntityBuilder<Components> builder) {
+        builder.spawn_batch<Position, Velocity>(
+            NUM_ENTITIES, [](EntityID id) { return Position{float(id), 0.f}; },
+            [](EntityID) { return Velocity{1.f}; });
+    });
+
+    std::unique_ptr<TestWorld> forked(
+        parent->fork([](auto&) {}, ThreadPoolOptions{.nthreads = 4}));
+    ARK_CHECK(forked != nullptr);
+    if (!forked) return;
+
+    std::vector<EntityID> ids;
+    std::vector<Position> positions;
+    parent->export_column(ids, positions);
+    ARK_CHECK(ids.size() == NUM_ENTITIES);
+
+    std::vector<Position> imported(ids.size());
+    std::vector<Velocity> velocities(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        imported[i] = Position{-float(ids[i]), 1.f};
+        velocities[i] = Velocity{2.f};
+    }
+    forked->import_columns(std::span<const EntityID>(ids),
+                           std::span<const Position>(imported),
+                           std::span<const Velocity>(velocities));
+
+    std::vector<EntityID> forked_ids, parent_ids;
+    std::vector<Position> forked_positions, parent_positions;
+    forked->export_column(forked_ids, forked_positions);
+    parent->export_column(parent_ids, parent_positions);
+    ARK_CHECK(forked_ids == ids && parent_ids == ids);
+    for (size_t i = 0; i < ids.size(); i++) {
+        ARK_CHECK(forked_positions[i].x == -float(ids[i]) && forked_positions[i].y == 1.f);
+        ARK_CHECK(parent_positions[i].x == float(ids[i]) && parent_positions[i].y == 0.f);
+    }
+
+    std::vector<Velocity> parent_velocities;
+    parent->export_column(parent_ids, parent_velocities);
+    for (const Velocity& velocity : parent_velocities) {
+        ARK_CHECK(velocity.dx == 1.f);
+    }
+}
+
+int main(void)
+{
+    import_into_fork_leaves_parent_unchanged();
+    return ark_test_result();
+}
@@ -0,0 +1,146 @@
+#include "ark/ark.hpp"
+#include "ark/storage/robin_hood.hpp"
+#include "ark/thread_pool.hpp"
+#include "test.hpp"
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+using namespace ark;
+
+struct Health {
+    int hp = 100;
+    static constexpr bool replicable = true;
+    using Storage = RobinHoodStorage<Health>;
+};
+
+struct Armor {
+    int value = 10;
+    static constexpr bool replicable = true;
+    using Storage = RobinHoodStorage<Armor>;
+};
+
+struct Local {
+    float value = 0.f;
+    using Storage = RobinHoodStorage<Local>;
+};
+
+struct Idle {
+    using Subscriptions = TypeList<>;
+    static void run(FollowedEntities) {}
+};
+
+struct Heal {
+    using Subscriptions = TypeList<Health>;
+
+    static void run(FollowedEntities followed, WriteComponent<Health> health)
+    {
+        followed.for_each_par([&](EntityID id) { health[id].hp += 1; });
+    }
+};
+
+template <typename... Components>
+using TestWorld = World<TypeList<Components...>, TypeList<Idle>>;
+
+template <typename... Components>
+std::vector<std::byte> full_delta(void)
+{
+    TestWorld<Components...> world(1);
+    world.build_entities([](EntityBuilder<TypeList<Components...>> builder) {
+        for (int i = 0; i < 10; i++) {
+            builder.new_entity().template attach<Health>().template attach<Armor>();
+        }
+    });
+
+    std::vector<std::byte> delta;
+    world.collect_delta(0, delta);
+    return delta;
+}
+
+// A delta's component masks are indexed by position in the World's component list, so it
+// must only be accepted by a World listing the same components in the same order.
+template <typename... Components, typename... Reordered>
+void check_delta_rejected_after_reordering(const TypeList<Components...>&,
+                                           const TypeList<Reordered...>&)
+{
+    const std::vector<std::byte> delta = full_delta<Components...>();
+
+    TestWorld<Components...> same(1);
+    ARK_CHECK(same.apply_delta(std::span<const std::byte>(delta)));
+    ARK_CHECK(same.entity_count() == 10);
+
+    TestWorld<Reordered...> reordered(1);
+    ARK_CHECK(!reordered.apply_delta(std::span<const std::byte>(delta)));
+    ARK_CHECK(reordered.entity_count() == 0);
+}
+
+using HealWorld = World<TypeList<Health>, TypeList<Heal>>;
+
+void build_wounded(HealWorld& world)
+{
+    world.build_entities([](EntityBuilder<TypeList<Health>> builder) {
+        for (int i = 0; i < 10; i++) {
+            builder.new_entity().attach<Health>();
+        }
+    });
+}
+
+// Writes are logged per thread of the World's own pool. A World's systems may also be run
+// from a worker of another pool, such as a forked World's from its parent's, and the writes
+// must be replicated just as when they are run from any other thread.
+void check_writes_from_another_pool_replicated(void)
+{
+    HealWorld world(1), other_pool_world(1);
+    build_wounded(world);
+    build_wounded(other_pool_world);
+    const uint64_t since = world.tick();
+
+    world.run_systems_parallel<Heal>();
+
+    ThreadPool other_pool(4);
+    other_pool.for_each_worker([&](size_t i) {
+        if (i == other_pool.nthreads()) other_pool_world.run_systems_parallel<Heal>();
+    });
+
+    std::vector<std::byte> delta, other_pool_delta;
+    world.collect_delta(since, delta);
+    other_pool_world.collect_delta(since, other_pool_delta);
+    ARK_CHECK(delta == other_pool_delta);
+}
+
+// A World whose history is never discarded keeps only the latest changes, up to its limit.
+// Receivers further behind get a complete delta instead.
+void check_history_bounded_without_discarding(void)
+{
+    HealWorld world(1);
+    world.set_delta_history_limit(50);
+    build_wounded(world);
+    const uint64_t since = world.tick();
+
+    for (int frame = 0; frame < 20; frame++) {
+        world.run_systems_sequential<Heal>();
+    }
+
+    std::vector<std::byte> behind, full, recent;
+    world.collect_delta(since, behind);
+    world.collect_delta(0, full);
+    world.collect_delta(world.tick() - 1, recent);
+    ARK_CHECK(behind == full);
+    ARK_CHECK(recent.size() < full.size());
+
+    HealWorld replica(1);
+    ARK_CHECK(replica.apply_delta(std::span<const std::byte>(behind)));
+    ARK_CHECK(replica.entity_count() == world.entity_count());
+}
+
+int main(void)
+{
+    check_delta_rejected_after_reordering(TypeList<Health, Armor>(),
+                                          TypeList<Armor, Health>());
+    check_delta_rejected_after_reordering(TypeList<Local, Health, Armor>(),
+                                          TypeList<Health, Local, Armor>());
+    check_writes_from_another_pool_replicated();
+    check_history_bounded_without_discarding();
+    return ark_test_result();
+}
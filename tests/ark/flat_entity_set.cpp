@@ -0,0 +1,172 @@
+#include "ark/flat_entity_set.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <span>
+#include <vector>
+
+using namespace ark;
+
+// FlatEntitySet consolidates early once its pending changes outnumber both its entities
+// and this many changes.
+constexpr size_t MIN_EAGER_CONSOLIDATION = 4096;
+
+// A FlatEntitySet together with a std::set receiving the same changes immediately.
+struct ModelledSet {
+    FlatEntitySet set;
+    std::set<EntityID> model;
+
+    void insert(std::vector<EntityID> ids)
+    {
+        set.insert_entities(std::span<const EntityID>(ids));
+        model.insert(ids.begin(), ids.end());
+    }
+
+    void remove(std::vector<EntityID> ids)
+    {
+        set.remove_entities(std::span<const EntityID>(ids));
+        for (const EntityID id : ids) {
+            model.erase(id);
+        }
+    }
+
+    bool matches(void)
+    {
+        set.consolidate();
+        return !set.has_pending_changes() &&
+               std::equal(set.begin(), set.end(), model.begin(), model.end());
+    }
+};
+
+// Only the last change requested for an entity counts, however many came before it.
+void check_interleaved_changes_to_same_entity(void)
+{
+    ModelledSet s;
+    s.insert({5});
+    s.remove({5});
+    ARK_CHECK(s.matches());
+
+    s.insert({5, 7});
+    s.remove({5});
+    s.insert({5});
+    s.remove({7, 5});
+    s.insert({7});
+    ARK_CHECK(s.matches());
+
+    s.insert({9, 9, 3});
+    s.remove({3, 9});
+    s.insert({3});
+    s.remove({7});
+    s.insert({7});
+    s.remove({7});
+    ARK_CHECK(s.matches());
+    ARK_CHECK(s.set.size() == 1 && s.set.contains(3));
+
+    // inserting a present entity and removing an absent one are no-ops
+    s.insert({3, 5});
+    s.remove({1000});
+    ARK_CHECK(s.matches());
+}
+
+// Batches don't have to be sorted, and may insert below the smallest entity in the set.
+void check_unsorted_batches_and_inserts_below_minimum(void)
+{
+    ModelledSet s;
+    std::vector<EntityID> high;
+    for (EntityID id = 2000; id > 1000; id--) {
+        high.push_back(id);
+    }
+    s.insert(high);
+    ARK_CHECK(s.matches());
+
+    s.insert({500, 1, 999, 42});
+    ARK_CHECK(s.matches());
+    ARK_CHECK(*s.set.begin() == 1);
+
+    s.insert({0, 1500, 3000, 7});
+    s.remove({2000, 1, 1001, 600});
+    ARK_CHECK(s.matches());
+    ARK_CHECK(*s.set.begin() == 0);
+}
+
+// Pending changes are consolidated as soon as they outnumber the entities in the set, or
+// MIN_EAGER_CONSOLIDATION for small sets, and the result is the same as consolidating late.
+void check_eager_consolidation_threshold(void)
+{
+    ModelledSet s;
+    std::vector<EntityID> batch(MIN_EAGER_CONSOLIDATION);
+    for (size_t i = 0; i < batch.size(); i++) {
+        batch[i] = EntityID(2 * i);
+    }
+    s.insert(batch);
+    ARK_CHECK(s.set.pending_count() == MIN_EAGER_CONSOLIDATION);
+    s.remove({0});
+    ARK_CHECK(!s.set.has_pending_changes());
+    ARK_CHECK(s.matches());
+
+    // grow the set past MIN_EAGER_CONSOLIDATION, the set's size becomes the threshold
+    std::vector<EntityID> more(2 * MIN_EAGER_CONSOLIDATION);
+    for (size_t i = 0; i < more.size(); i++) {
+        more[i] = EntityID(2 * i + 1);
+    }
+    s.insert(more);
+    ARK_CHECK(s.matches());
+
+    const size_t size = s.set.size();
+    std::vector<EntityID> removals(size);
+    for (size_t i = 0; i < size; i++) {
+        removals[i] = EntityID(i + 100000);
+    }
+    s.remove(removals);
+    ARK_CHECK(s.set.pending_count() == size);
+    s.insert({1});
+    ARK_CHECK(!s.set.has_pending_changes());
+    ARK_CHECK(s.matches());
+
+    // changes queued after an eager consolidation are still applied in order
+    s.insert(removals);
+    s.remove({1, 3, 5});
+    s.insert({5});
+    ARK_CHECK(s.matches());
+}
+
+// Random batches of unsorted, overlapping insertions and removals, consolidated at random
+// points (and eagerly whenever the threshold is crossed).
+void check_random_batches(void)
+{
+    std::mt19937 rng(1234);
+    ModelledSet s;
+
+    for (int round = 0; round < 2000; round++) {
+        const EntityID max_id = round % 3 == 0 ? 100 : 20000;
+        std::uniform_int_distribution<EntityID> any_id(0, max_id);
+        std::uniform_int_distribution<size_t> batch_size(0, round % 50 == 0 ? 6000 : 64);
+
+        std::vector<EntityID> batch(batch_size(rng));
+        for (EntityID& id : batch) {
+            id = any_id(rng);
+        }
+        if (rng() % 4 == 0) std::sort(batch.begin(), batch.end());
+
+        if (rng() % 3 == 0) {
+            s.remove(batch);
+        }
+        else {
+            s.insert(batch);
+        }
+
+        if (rng() % 8 == 0) ARK_CHECK(s.matches());
+    }
+    ARK_CHECK(s.matches());
+}
+
+int main(void)
+{
+    check_interleaved_changes_to_same_entity();
+    check_unsorted_batches_and_inserts_below_minimum();
+    check_eager_consolidation_threshold();
+    check_random_batches();
+    return ark_test_result();
+}
@@ -0,0 +1,47 @@
+#include "ark/frame_arena.hpp"
+#include "ark/thread_pool.hpp"
+#include "test.hpp"
+
+#include <vector>
+
+using namespace ark;
+
+// Each World owns a ThreadPool, and a forked World's systems may be run from a worker of
+// its parent's pool. Such a thread is the calling thread for the forked World, so it must
+// get that World's arena 0 and not the arena matching its index in the other pool.
+void arenas_follow_their_own_pool(void)
+{
+    ThreadPool parent_pool(4);
+    ThreadPool forked_pool(1);
+    FrameArenas forked_arenas(forked_pool);
+
+    BumpAllocator* calling_thread_arena = &forked_arenas.local();
+
+    std::vector<BumpAllocator*> from_parent(parent_pool.nthreads() + 1, nullptr);
+    std::vector<size_t> parent_indices(parent_pool.nthreads() + 1, 0);
+    parent_pool.for_each_worker([&](size_t i) {
+        from_parent[i] = &forked_arenas.local();
+        parent_indices[i] = parent_pool.worker_index();
+    });
+
+    for (size_t i = 1; i <= parent_pool.nthreads(); i++) {
+        ARK_CHECK(parent_indices[i] == i);
+        ARK_CHECK(from_parent[i] == calling_thread_arena);
+    }
+
+    BumpAllocator* from_forked_worker = nullptr;
+    size_t parent_index_of_forked_worker = 1;
+    forked_pool.for_each_worker([&](size_t) {
+        from_forked_worker = &forked_arenas.local();
+        parent_index_of_forked_worker = parent_pool.worker_index();
+    });
+
+    ARK_CHECK(from_forked_worker != nullptr && from_forked_worker != calling_thread_arena);
+    ARK_CHECK(parent_index_of_forked_worker == 0);
+}
+
+int main(void)
+{
+    arenas_follow_their_own_pool();
+    return ark_test_result();
+}
@@ -0,0 +1,66 @@
+#ifndef ARK_ENABLE_STATS
+#define ARK_ENABLE_STATS
+#endif
+
+#include "ark/ark.hpp"
+#include "ark/storage/bucket_array.hpp"
+#include "ark/storage/robin_hood.hpp"
+#include "test.hpp"
+
+using namespace ark;
+
+struct Position {
+    float x = 0.f;
+    using Storage = BucketArrayStorage<Position, 1024>;
+};
+
+struct Health {
+    int hp = 100;
+    using Storage = RobinHoodStorage<Health>;
+};
+
+using Components = TypeList<Position, Health>;
+
+struct Idle {
+    using Subscriptions = TypeList<Position>;
+    static void run(FollowedEntities) {}
+};
+
+using TestWorld = World<Components, TypeList<Idle>>;
+
+// The World reserves room in its hash maps for every batch of new entities. In incremental
+// rehash mode those reservations must not fall back to rehashing everything at once.
+void batches_never_rehash_in_full(void)
+{
+    TestWorld world(1);
+    world.set_incremental_rehash(true);
+    world.reset_stats();
+
+    for (int batch = 0; batch < 4000; batch++) {
+        world.build_entities([](EntityBuilder<Components> builder) {
+            if (builder.new_entity().attach<Position>().id() % 2 == 0) {
+                builder.spawn_batch<Position, Health>(49);
+            }
+            else {
+                for (int i = 0; i < 49; i++) {
+                    builder.new_entity().attach<Position>().attach<Health>();
+                }
+            }
+        });
+    }
+    ARK_CHECK(world.entity_count() == 4000 * 50);
+
+    const StatsReport report = world.stats_report();
+    ARK_CHECK(report.entity_masks[Stat::MapRehashes] == 0);
+    ARK_CHECK(report.entity_masks[Stat::MapIncrementalRehashes] > 0);
+    for (const auto& [component, counters] : report.components) {
+        ARK_CHECK(counters[Stat::MapRehashes] == 0);
+        ARK_CHECK(counters[Stat::MapIncrementalRehashes] > 0);
+    }
+}
+
+int main(void)
+{
+    batches_never_rehash_in_full();
+    return ark_test_result();
+}
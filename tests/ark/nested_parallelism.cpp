@@ -0,0 +1,72 @@
+#include "ark/ark.hpp"
+#include "ark/storage/bucket_array.hpp"
+#include "test.hpp"
+
+#include <array>
+#include <memory>
+#include <utility>
+
+using namespace ark;
+
+template <size_t N>
+struct Counter {
+    size_t value = 0;
+    using Storage = BucketArrayStorage<Counter<N>, 256>;
+};
+
+constexpr size_t NUM_SYSTEMS = 8;
+constexpr size_t NUM_ENTITIES = 5000;
+constexpr size_t FRAMES = 10;
+
+inline std::array<size_t, NUM_SYSTEMS> totals{};
+
+// Adds N + 1 to its counter of every entity, then sums them up, each with its own fork/join
+// on the World's pool from within run_systems_parallel.
+template <size_t N>
+struct Count {
+    using Subscriptions = TypeList<Counter<N>>;
+
+    static void run(FollowedEntities followed, WriteComponent<Counter<N>> counter)
+    {
+        followed.for_each_par([&](EntityID id) { counter[id].value += N + 1; });
+        totals[N] = followed.for_each_par_reduce(
+            size_t(0), [&](size_t& sum, EntityID id) { sum += counter[id].value; },
+            [](size_t a, size_t b) { return a + b; });
+    }
+};
+
+template <size_t... Ns>
+void check_more_systems_than_workers(ThreadPoolOptions options, std::index_sequence<Ns...>)
+{
+    using Components = TypeList<Counter<Ns>...>;
+    using TestWorld = World<Components, TypeList<Count<Ns>...>>;
+
+    std::unique_ptr<TestWorld> world(TestWorld::init([](auto&) {}, options));
+    world->build_entities([](EntityBuilder<Components> builder) {
+        builder.template spawn_batch<Counter<Ns>...>(NUM_ENTITIES);
+    });
+
+    for (size_t frame = 1; frame <= FRAMES; frame++) {
+        world->template run_systems_parallel<Count<Ns>...>();
+        ARK_CHECK(((totals[Ns] == NUM_ENTITIES * frame * (Ns + 1)) && ...));
+    }
+}
+
+// run_systems_parallel runs each system as a task on the World's pool, and every system
+// running for_each_par waits on tasks of its own. With more systems than threads, threads
+// waiting on their own tasks must keep running the others' so that every frame completes.
+void check_nested_fork_join(void)
+{
+    for (const size_t nthreads : {1, 2}) {
+        for (const bool sticky : {false, true}) {
+            const ThreadPoolOptions options{.nthreads = nthreads, .sticky_tasks = sticky};
+            check_more_systems_than_workers(options, std::make_index_sequence<NUM_SYSTEMS>());
+        }
+    }
+}
+
+int main(void)
+{
+    check_nested_fork_join();
+    return ark_test_result();
+}
@@ -0,0 +1,107 @@
+#include "ark/storage/paged.hpp"
+#include "test.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace ark;
+
+constexpr size_t PAGE_SIZE = 256;
+constexpr int ROUNDS = 2000;
+
+// Two threads write to a page the storage shares with its parent, as systems do from
+// for_each_par in a forked World. Exactly one copy of the page must be made, and neither
+// thread may write into the parent's page.
+void write_shared_page_from_two_threads(void)
+{
+    PagedStorage<int, PAGE_SIZE> parent;
+    for (EntityID id = 0; id < PAGE_SIZE; id++) {
+        parent.attach(id, -1);
+    }
+
+    for (int round = 0; round < ROUNDS; round++) {
+        PagedStorage<int, PAGE_SIZE> child;
+        child.copy_from(parent);
+        ARK_CHECK(child.shared_pages() == 1);
+
+        std::atomic<int> ready(0);
+        auto write_every_other = [&](EntityID first) {
+            ready.fetch_add(1);
+            while (ready.load() < 2) {
+                std::this_thread::yield();
+            }
+            for (EntityID id = first; id < PAGE_SIZE; id += 2) {
+                child.get(id) = round;
+            }
+        };
+
+        std::thread even(write_every_other, 0);
+        std::thread odd(write_every_other, 1);
+        even.join();
+        odd.join();
+
+        ARK_CHECK(child.shared_pages() == 0);
+        for (EntityID id = 0; id < PAGE_SIZE; id++) {
+            ARK_CHECK(std::as_const(child).get(id) == round);
+            ARK_CHECK(std::as_const(parent).get(id) == -1);
+        }
+    }
+}
+
+constexpr size_t SHARED_PAGES = 2000;
+constexpr size_t WRITERS = 3;
+constexpr int SHARED_ROUNDS = 50;
+
+// A World and its fork, or two sibling forks, can each run systems on their own pool at the
+// same time, all writing to the pages they share. Each storage must end up with only its
+// own writes, and no page may be freed while one of its threads still writes to it.
+void write_pages_shared_by_two_storages(void)
+{
+    constexpr EntityID num_ids = SHARED_PAGES * 64;
+
+    for (int round = 0; round < SHARED_ROUNDS; round++) {
+        PagedStorage<int, 64> a;
+        for (EntityID id = 0; id < num_ids; id++) {
+            a.attach(id, -1);
+        }
+        PagedStorage<int, 64> b;
+        b.copy_from(a);
+        ARK_CHECK(a.shared_pages() == SHARED_PAGES);
+
+        std::atomic<size_t> ready(0);
+        auto write = [&](PagedStorage<int, 64>* storage, EntityID first, int value) {
+            ready.fetch_add(1);
+            while (ready.load() < 2 * WRITERS) {
+                std::this_thread::yield();
+            }
+            for (EntityID id = first; id < num_ids; id += WRITERS) {
+                storage->get(id) = value;
+            }
+        };
+
+        std::vector<std::thread> writers;
+        for (EntityID t = 0; t < WRITERS; t++) {
+            writers.emplace_back(write, &a, t, 1);
+            writers.emplace_back(write, &b, t, 2);
+        }
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+
+        ARK_CHECK(a.shared_pages() == 0 && b.shared_pages() == 0);
+        size_t lost_writes = 0;
+        for (EntityID id = 0; id < num_ids; id++) {
+            lost_writes += std::as_const(a).get(id) != 1;
+            lost_writes += std::as_const(b).get(id) != 2;
+        }
+        ARK_CHECK(lost_writes == 0);
+    }
+}
+
+int main(void)
+{
+    write_shared_page_from_two_threads();
+    write_pages_shared_by_two_storages();
+    return ark_test_result();
+}
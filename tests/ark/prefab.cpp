@@ -0,0 +1,84 @@
+#include "ark/ark.hpp"
+#include "ark/prefab.hpp"
+#include "ark/storage/bucket_array.hpp"
+#include "test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace ark;
+
+struct Position {
+    float x = 0.f;
+    float y = 0.f;
+    using Storage = BucketArrayStorage<Position, 64>;
+};
+
+struct Name {
+    std::string value;
+    using Storage = BucketArrayStorage<Name, 64>;
+};
+
+using Components = TypeList<Position, Name>;
+
+struct Cull {
+    using Subscriptions = TypeList<Position>;
+
+    static void run(FollowedEntities followed, EntityDestroyer destroy)
+    {
+        for (const EntityID id : followed) {
+            if (id % 3 == 0) destroy(id);
+        }
+    }
+};
+
+using TestWorld = World<Components, TypeList<Cull>>;
+
+void copy_non_const_prefab(void)
+{
+    Prefab<Position, Name> prefab(Position{1.f, 2.f}, Name{"orc"});
+    Prefab<Position, Name> copy(prefab);
+    ARK_CHECK(copy.get<Name>().value == "orc");
+    ARK_CHECK(copy.get<Position>().y == 2.f);
+}
+
+// Instantiating fills the open slots left by destroyed entities first, then new buckets,
+// copying the prefab's components into each.
+void instantiate_into_partially_full_buckets(void)
+{
+    TestWorld world(1);
+    world.build_entities([](EntityBuilder<Components> builder) {
+        builder.spawn_batch<Position, Name>(
+            100, [](EntityID id) { return Position{float(id), 0.f}; },
+            [](EntityID) { return Name{"human"}; });
+    });
+    world.run_systems_sequential<Cull>();
+    const size_t survivors = world.entity_count();
+
+    const Prefab<Position, Name> prefab(Position{1.f, 2.f}, Name{"a name too long for SSO"});
+    const EntityID first = world.instantiate(prefab, 150);
+    ARK_CHECK(world.entity_count() == survivors + 150);
+
+    std::vector<EntityID> ids;
+    std::vector<Position> positions;
+    world.export_column(ids, positions);
+    ARK_CHECK(ids.size() == survivors + 150);
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (ids[i] >= first) ARK_CHECK(positions[i].x == 1.f && positions[i].y == 2.f);
+        else ARK_CHECK(positions[i].x == float(ids[i]));
+    }
+
+    std::vector<Name> names;
+    world.export_column(ids, names);
+    ARK_CHECK(ids.size() == survivors + 150);
+    for (size_t i = 0; i < ids.size(); i++) {
+        ARK_CHECK(names[i].value == (ids[i] >= first ? "a name too long for SSO" : "human"));
+    }
+}
+
+int main(void)
+{
+    copy_non_const_prefab();
+    instantiate_into_partially_full_buckets();
+    return ark_test_result();
+}
@@ -0,0 +1,182 @@
+#include "ark/ark.hpp"
+#include "ark/storage/bucket_array.hpp"
+#include "ark/storage/paged.hpp"
+#include "ark/storage/robin_hood.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace ark;
+
+struct Position {
+    float x = 0.f;
+    using Storage = BucketArrayStorage<Position, 64>;
+    bool operator==(const Position&) const = default;
+};
+
+// not trivially copyable, so buckets are copied slot by slot
+struct Name {
+    std::string value;
+    using Storage = BucketArrayStorage<Name, 64>;
+    bool operator==(const Name&) const = default;
+};
+
+struct Health {
+    int hp = 100;
+    using Storage = RobinHoodStorage<Health>;
+    bool operator==(const Health&) const = default;
+};
+
+struct Velocity {
+    float dx = 1.f;
+    using Storage = PagedStorage<Velocity>;
+    bool operator==(const Velocity&) const = default;
+};
+
+using Components = TypeList<Position, Name, Health, Velocity>;
+
+struct Move {
+    using Subscriptions = TypeList<Position, Velocity>;
+
+    static void run(FollowedEntities followed, WriteComponent<Position> position,
+                    ReadComponent<Velocity> velocity)
+    {
+        followed.for_each_par([&](EntityID id) { position[id].x += velocity[id].dx; });
+    }
+};
+
+struct Rename {
+    using Subscriptions = TypeList<Name, Health>;
+
+    static void run(FollowedEntities followed, WriteComponent<Name> name,
+                    WriteComponent<Health> health, EntityDestroyer destroy)
+    {
+        for (const EntityID id : followed) {
+            name[id].value += "!";
+            health[id].hp -= 7;
+            if (id % 5 == 0) destroy(id);
+        }
+    }
+};
+
+using TestWorld = World<Components, TypeList<Move, Rename>>;
+
+// Spawn 'count' entities with a varying mix of components.
+void spawn(TestWorld& world, size_t count)
+{
+    world.build_entities([count](EntityBuilder<Components> builder) {
+        for (size_t i = 0; i < count; i++) {
+            auto entity = builder.new_entity();
+            const EntityID id = entity.id();
+            entity.attach<Position>(Position{float(id)});
+            if (id % 2 == 0) {
+                // long enough not to fit in std::string's inline buffer
+                entity.attach<Name>(Name{"entity with a long name #" + std::to_string(id)});
+            }
+            if (id % 3 != 0) entity.attach<Health>(Health{int(id)});
+            if (id % 4 != 0) entity.attach<Velocity>(Velocity{float(id % 7)});
+        }
+    });
+}
+
+void play(TestWorld& world, int frames)
+{
+    for (int frame = 0; frame < frames; frame++) {
+        world.run_systems_parallel<Move, Rename>();
+    }
+}
+
+template <Component T>
+std::vector<std::pair<EntityID, T>> column(const TestWorld& world)
+{
+    std::vector<EntityID> ids;
+    std::vector<T> values;
+    world.export_column(ids, values);
+
+    std::vector<std::pair<EntityID, T>> result;
+    for (size_t i = 0; i < ids.size(); i++) {
+        result.emplace_back(ids[i], values[i]);
+    }
+    std::sort(result.begin(), result.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    return result;
+}
+
+// Everything observable about the entities of a World.
+struct State {
+    size_t entity_count;
+    std::vector<std::pair<EntityID, Position>> positions;
+    std::vector<std::pair<EntityID, Name>> names;
+    std::vector<std::pair<EntityID, Health>> healths;
+    std::vector<std::pair<EntityID, Velocity>> velocities;
+
+    explicit State(const TestWorld& world)
+        : entity_count(world.entity_count()), positions(column<Position>(world)),
+          names(column<Name>(world)), healths(column<Health>(world)),
+          velocities(column<Velocity>(world))
+    {
+    }
+
+    bool operator==(const State&) const = default;
+};
+
+// Rolling back restores exactly the entities and components saved by the checkpoint, even
+// after the World grew well past it, and the World carries on as if nothing had happened.
+void rollback_restores_checkpoint(void)
+{
+    TestWorld world(2), twin(2);
+    for (TestWorld* w : {&world, &twin}) {
+        spawn(*w, 300);
+        play(*w, 2);
+    }
+
+    world.checkpoint();
+    const State saved(world);
+    ARK_CHECK(saved == State(twin));
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        play(world, 3);
+        spawn(world, 2000);
+        play(world, 1);
+        ARK_CHECK(!(State(world) == saved));
+
+        ARK_CHECK(world.rollback());
+        ARK_CHECK(State(world) == saved);
+    }
+
+    for (TestWorld* w : {&world, &twin}) {
+        spawn(*w, 100);
+        play(*w, 2);
+    }
+    ARK_CHECK(State(world) == State(twin));
+}
+
+// Cloning into a World that already has more buckets, and more entities, than the source.
+void clone_into_larger_world(void)
+{
+    TestWorld small(1), large(1), twin(1);
+    spawn(small, 100);
+    spawn(twin, 100);
+    spawn(large, 5000);
+    play(large, 2);
+
+    small.clone_into(large);
+    ARK_CHECK(State(large) == State(small));
+
+    for (TestWorld* w : {&large, &twin}) {
+        play(*w, 2);
+        spawn(*w, 50);
+        play(*w, 1);
+    }
+    ARK_CHECK(State(large) == State(twin));
+}
+
+int main(void)
+{
+    rollback_restores_checkpoint();
+    clone_into_larger_world();
+    return ark_test_result();
+}
@@ -0,0 +1,102 @@
+#include "ark/ark.hpp"
+#include "ark/storage/bucket_array.hpp"
+#include "ark/storage/robin_hood.hpp"
+#include "test.hpp"
+
+#include <cstring>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+using namespace ark;
+
+struct Position {
+    float x = 0.f;
+    float y = 0.f;
+    using Storage = BucketArrayStorage<Position, 256>;
+};
+
+struct Health {
+    int hp = 100;
+    using Storage = RobinHoodStorage<Health>;
+};
+
+using Components = TypeList<Position, Health>;
+
+struct Cull {
+    using Subscriptions = TypeList<Position>;
+
+    static void run(FollowedEntities followed, EntityDestroyer destroy)
+    {
+        for (const EntityID id : followed) {
+            if (id % 4 == 0) destroy(id);
+        }
+    }
+};
+
+using TestWorld = World<Components, TypeList<Cull>>;
+
+// Hands out memory filled with 'm_garbage', as freshly allocated heap memory may be.
+class GarbageResource : public std::pmr::memory_resource {
+    unsigned char m_garbage;
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        void* memory = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        std::memset(memory, m_garbage, bytes);
+        return memory;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+public:
+    explicit GarbageResource(unsigned char garbage) : m_garbage(garbage) {}
+};
+
+std::vector<std::byte> snapshot_of_world_on(std::pmr::memory_resource* resource)
+{
+    TestWorld world(1);
+    world.set_memory_resource(resource);
+    world.build_entities([](EntityBuilder<Components> builder) {
+        builder.spawn_batch<Position, Health>(
+            1000, [](EntityID id) { return Position{float(id), 1.f}; },
+            [](EntityID id) { return Health{int(id)}; });
+    });
+    world.run_systems_sequential<Cull>();
+
+    std::vector<std::byte> snapshot;
+    ARK_CHECK(world.save_snapshot(snapshot));
+    return snapshot;
+}
+
+// Empty slots of storage arrays and hash tables are written as zeros, whatever the memory
+// they were allocated from held, so that identical Worlds have identical snapshots.
+void identical_worlds_have_identical_snapshots(void)
+{
+    GarbageResource a(0xAB), b(0xCD);
+    const std::vector<std::byte> snapshot_a = snapshot_of_world_on(&a);
+    const std::vector<std::byte> snapshot_b = snapshot_of_world_on(&b);
+    ARK_CHECK(snapshot_a == snapshot_b);
+
+    TestWorld restored(1);
+    ARK_CHECK(restored.load_snapshot(std::span<const std::byte>(snapshot_a)));
+    ARK_CHECK(restored.entity_count() == 750);
+
+    std::vector<std::byte> resaved;
+    ARK_CHECK(restored.save_snapshot(resaved));
+    ARK_CHECK(resaved == snapshot_a);
+}
+
+int main(void)
+{
+    identical_worlds_have_identical_snapshots();
+    return ark_test_result();
+}
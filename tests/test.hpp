@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+// Unlike assert, checks stay on in release builds and report every failure before the test
+// exits with a nonzero status (see ark_test_result).
+inline int& ark_test_failures(void)
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define ARK_CHECK(condition)                                                                  \
+    do {                                                                                      \
+        if (!(condition)) {                                                                   \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition         \
+                      << std::endl;                                                           \
+            ark_test_failures()++;                                                            \
+        }                                                                                     \
+    } while (false)
+
+inline int ark_test_result(void)
+{
+    if (ark_test_failures() == 0) return EXIT_SUCCESS;
+    std::cerr << ark_test_failures() << " check(s) failed" << std::endl;
+    return EXIT_FAILURE;
+}